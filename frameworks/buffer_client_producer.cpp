@@ -22,16 +22,87 @@
 #include "buffer_common.h"
 #include "buffer_manager.h"
 #include "buffer_queue.h"
+#include "securec.h"
 #include "surface_buffer_impl.h"
 
 namespace OHOS {
 const int32_t DEFAULT_IPC_SIZE = 200;
-BufferClientProducer::BufferClientProducer(const SvcIdentity& sid) : sid_(sid)
+BufferClientProducer::BufferClientProducer(const SvcIdentity& sid)
+    : sid_(sid),
+      attrCache_({{0}, 0, 0, 0}),
+      attrCacheValid_(false),
+      resetSeq_(0),
+      controlBuffer_(nullptr),
+      controlRing_(nullptr),
+      asyncFlush_(false),
+      asyncFlushError_(SURFACE_ERROR_OK)
 {
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        cachedBuffers_[i] = nullptr;
+    }
 }
 
 BufferClientProducer::~BufferClientProducer()
 {
+    ReleaseCachedBuffers(true);
+    if (controlBuffer_ != nullptr) {
+        BufferManager* manager = BufferManager::GetInstance();
+        if (manager != nullptr) {
+            manager->UnmapBuffer(*controlBuffer_);
+        }
+        delete controlBuffer_;
+        controlBuffer_ = nullptr;
+        controlRing_ = nullptr;
+    }
+}
+
+void BufferClientProducer::ReleaseCachedBuffers(bool force)
+{
+    BufferManager* manager = BufferManager::GetInstance();
+    RETURN_IF_FAIL(manager);
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        SurfaceBufferImpl* buffer = cachedBuffers_[i];
+        /* Buffer held by user is kept, it will be checked by generation when requested again. */
+        if (buffer == nullptr || (!force && buffer->GetState() == BUFFER_STATE_REQUEST)) {
+            continue;
+        }
+        manager->UnmapBuffer(*buffer);
+        delete buffer;
+        cachedBuffers_[i] = nullptr;
+    }
+}
+
+bool BufferClientProducer::IsCachedBuffer(const SurfaceBufferImpl* buffer) const
+{
+    uint8_t slot = buffer->GetSlot();
+    return slot < BUFFER_QUEUE_SLOT_COUNT && cachedBuffers_[slot] == buffer;
+}
+
+SurfaceBufferImpl* BufferClientProducer::GetCachedBuffer(SurfaceBufferImpl& replyBuffer)
+{
+    uint8_t slot = replyBuffer.GetSlot();
+    if (slot >= BUFFER_QUEUE_SLOT_COUNT) {
+        return nullptr;
+    }
+    SurfaceBufferImpl* buffer = cachedBuffers_[slot];
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    if (buffer->GetKey() == replyBuffer.GetKey() && buffer->GetPhyAddr() == replyBuffer.GetPhyAddr() &&
+        buffer->GetGeneration() == replyBuffer.GetGeneration()) {
+        buffer->MoveExtraData(replyBuffer);
+        return buffer;
+    }
+    /* The slot is attached with another buffer, which means the cached one is detached by server. */
+    cachedBuffers_[slot] = nullptr;
+    if (buffer->GetState() != BUFFER_STATE_REQUEST) {
+        BufferManager* manager = BufferManager::GetInstance();
+        if (manager != nullptr) {
+            manager->UnmapBuffer(*buffer);
+        }
+        delete buffer;
+    }
+    return nullptr;
 }
 
 SurfaceBufferImpl* BufferClientProducer::RequestBuffer(uint8_t wait)
@@ -40,9 +111,82 @@ SurfaceBufferImpl* BufferClientProducer::RequestBuffer(uint8_t wait)
     uint8_t requestIoData[DEFAULT_IPC_SIZE];
     IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
     IpcIoPushUint8(&requestIo, wait);
+    IpcIoPushUint32(&requestIo, attrCacheValid_ ? attrCache_.sequence : 0);
+    return RequestBufferByCode(REQUEST_BUFFER, requestIo);
+}
+
+SurfaceBufferImpl* BufferClientProducer::RequestBuffer(uint8_t wait, int64_t timeout)
+{
+    IpcIo requestIo;
+    uint8_t requestIoData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
+    IpcIoPushUint8(&requestIo, wait);
+    IpcIoPushInt64(&requestIo, timeout);
+    IpcIoPushUint32(&requestIo, attrCacheValid_ ? attrCache_.sequence : 0);
+    return RequestBufferByCode(REQUEST_BUFFER_TIMEOUT, requestIo);
+}
+
+SurfaceBufferImpl* BufferClientProducer::RequestBufferFromRing()
+{
+    if (controlRing_ == nullptr) {
+        return nullptr;
+    }
+    bool canceled = false;
+    BufferControlEntry entry;
+    while (BufferQueue::PopControlEntry(controlRing_->freeQueue, entry)) {
+        SurfaceBufferImpl* buffer = (entry.slot < BUFFER_QUEUE_SLOT_COUNT) ? cachedBuffers_[entry.slot] : nullptr;
+        if (buffer != nullptr && buffer->GetGeneration() == entry.generation &&
+            buffer->GetState() != BUFFER_STATE_REQUEST && entry.resetSeq == controlRing_->resetSeq.load()) {
+            buffer->SetState(BUFFER_STATE_REQUEST);
+            return buffer;
+        }
+        /* Not mapped yet or attached before reset, give it back and request a mapped one by ipc. */
+        entry.canceled = 1;
+        if (!BufferQueue::PushControlEntry(controlRing_->dirtyQueue, entry)) {
+            GRAPHIC_LOGW("Control ring is full, slot=%u", entry.slot);
+        }
+        canceled = true;
+    }
+    if (canceled) {
+        NotifyControlRing(true);
+    }
+    return nullptr;
+}
+
+SurfaceBufferImpl* BufferClientProducer::RequestBufferByCode(uint32_t code, IpcIo& requestIo)
+{
+    while (true) {
+        SurfaceBufferImpl* buffer = RequestBufferFromRing();
+        if (buffer != nullptr) {
+            return buffer;
+        }
+        buffer = TransactRequestBuffer(code, requestIo);
+        /* Buffer queue does not wait while free buffers are in control ring, take them from there. */
+        if (buffer != nullptr || controlRing_ == nullptr ||
+            BufferQueue::GetControlQueueSize(controlRing_->freeQueue) == 0) {
+            return buffer;
+        }
+    }
+}
+
+SurfaceBufferImpl* BufferClientProducer::CreateBuffer(SurfaceBufferImpl& replyBuffer)
+{
+    SurfaceBufferImpl* buffer = new SurfaceBufferImpl();
+    buffer->SetKey(replyBuffer.GetKey());
+    buffer->SetPhyAddr(replyBuffer.GetPhyAddr());
+    buffer->SetReserveFds(replyBuffer.GetReserveFds());
+    buffer->SetReserveInts(replyBuffer.GetReserveInts());
+    buffer->SetMaxSize(replyBuffer.GetMaxSize());
+    buffer->SetUsage(replyBuffer.GetUsage());
+    buffer->SetSlot(replyBuffer.GetSlot(), replyBuffer.GetGeneration());
+    return buffer;
+}
+
+SurfaceBufferImpl* BufferClientProducer::TransactRequestBuffer(uint32_t code, IpcIo& requestIo)
+{
     IpcIo reply;
     uintptr_t ptr;
-    int32_t ret = Transact(nullptr, sid_, REQUEST_BUFFER, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    int32_t ret = Transact(nullptr, sid_, code, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
     if (ret != 0) {
         GRAPHIC_LOGW("RequestBuffer Transact failed");
         return nullptr;
@@ -50,26 +194,38 @@ SurfaceBufferImpl* BufferClientProducer::RequestBuffer(uint8_t wait)
     ret = IpcIoPopInt32(&reply);
     if (ret != 0) {
         GRAPHIC_LOGW("RequestBuffer generic failed code=%d", ret);
+        UpdateAttrCache(reply);
+        UpdateAsyncFlushError(reply);
         FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
         return nullptr;
     }
 
-    SurfaceBufferImpl* buffer = new SurfaceBufferImpl();
-    buffer->ReadFromIpcIo(reply);
+    SurfaceBufferImpl replyBuffer;
+    replyBuffer.ReadFromIpcIo(reply);
+    UpdateAttrCache(reply);
+    UpdateAsyncFlushError(reply);
+    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+    SurfaceBufferImpl* buffer = GetCachedBuffer(replyBuffer);
+    if (buffer != nullptr) {
+        buffer->SetState(BUFFER_STATE_REQUEST);
+        return buffer;
+    }
+
     BufferManager* manager = BufferManager::GetInstance();
     if (manager == nullptr) {
-        GRAPHIC_LOGW("BufferManager is null, usage(%d)", buffer->GetUsage());
-        delete buffer;
-        FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+        GRAPHIC_LOGW("BufferManager is null, usage(%d)", replyBuffer.GetUsage());
         return nullptr;
     }
-
+    buffer = CreateBuffer(replyBuffer);
+    buffer->MoveExtraData(replyBuffer);
     if (!manager->MapBuffer(*buffer)) {
         Cancel(buffer);
-        FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
         return nullptr;
     }
-    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+    if (buffer->GetSlot() < BUFFER_QUEUE_SLOT_COUNT) {
+        cachedBuffers_[buffer->GetSlot()] = buffer;
+    }
+    buffer->SetState(BUFFER_STATE_REQUEST);
     return buffer;
 }
 
@@ -86,26 +242,141 @@ int32_t BufferClientProducer::FlushBuffer(SurfaceBufferImpl* buffer)
             return ret;
         }
     }
+    if (FlushBufferToRing(buffer)) {
+        buffer->SetState(BUFFER_STATE_FLUSH);
+        return SURFACE_ERROR_OK;
+    }
+    ret = TransactFlushBuffer(buffer);
+    if (ret != SURFACE_ERROR_OK) {
+        return ret;
+    }
+    if (IsCachedBuffer(buffer)) {
+        buffer->SetState(BUFFER_STATE_FLUSH);
+        buffer->ClearExtraData();
+        return ret;
+    }
+    manager->UnmapBuffer(*buffer);
+    delete buffer;
+    return ret;
+}
+
+int32_t BufferClientProducer::TransactFlushBuffer(SurfaceBufferImpl* buffer)
+{
+    /* Buffer with blobs may not fit in the default ipc data. */
+    uint8_t requestIoInlineData[DEFAULT_IPC_SIZE];
+    uint8_t* requestIoData = requestIoInlineData;
+    uint32_t ipcSize = buffer->GetIpcSize();
+    if (ipcSize > DEFAULT_IPC_SIZE) {
+        requestIoData = static_cast<uint8_t*>(malloc(ipcSize));
+        if (requestIoData == nullptr) {
+            GRAPHIC_LOGE("Couldn't allocate %u bytes for ipc data", ipcSize);
+            return SURFACE_ERROR_SYSTEM_ERROR;
+        }
+    } else {
+        ipcSize = DEFAULT_IPC_SIZE;
+    }
+    IpcIo requestIo;
+    IpcIoInit(&requestIo, requestIoData, ipcSize, 0);
+    buffer->WriteToIpcIo(requestIo);
+    int32_t ret;
+    if (asyncFlush_) {
+        ret = Transact(nullptr, sid_, FLUSH_BUFFER_ASYNC, &requestIo, nullptr, LITEIPC_FLAG_ONEWAY, nullptr);
+        if (ret != SURFACE_ERROR_OK) {
+            GRAPHIC_LOGW("FlushBuffer async failed");
+        }
+    } else {
+        IpcIo reply;
+        uintptr_t ptr;
+        ret = Transact(nullptr, sid_, FLUSH_BUFFER, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+        if (ret != SURFACE_ERROR_OK) {
+            GRAPHIC_LOGW("FlushBuffer failed");
+        } else {
+            ret = IpcIoPopInt32(&reply);
+            FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+            if (ret != SURFACE_ERROR_OK) {
+                GRAPHIC_LOGW("FlushBuffer failed code=%d", ret);
+                ret = -1;
+            }
+        }
+    }
+    if (requestIoData != requestIoInlineData) {
+        free(requestIoData);
+    }
+    return ret;
+}
+
+bool BufferClientProducer::FlushBufferToRing(SurfaceBufferImpl* buffer)
+{
+    /* Extra data and damage could not be carried by control ring, flush them by ipc. */
+    if (controlRing_ == nullptr || !IsCachedBuffer(buffer) || buffer->HasExtraData()) {
+        return false;
+    }
+    BufferControlEntry entry = {buffer->GetSlot(), 0, buffer->GetGeneration(), 0};
+    if (!BufferQueue::PushControlEntry(controlRing_->dirtyQueue, entry)) {
+        return false;
+    }
+    NotifyControlRing(false);
+    return true;
+}
+
+void BufferClientProducer::NotifyControlRing(bool needReply)
+{
+    IpcIo requestIo;
+    uint8_t requestIoData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
+    IpcIoPushBool(&requestIo, needReply);
+    if (!needReply) {
+        int32_t ret = Transact(nullptr, sid_, NOTIFY_CONTROL_RING, &requestIo, nullptr, LITEIPC_FLAG_ONEWAY, nullptr);
+        if (ret != SURFACE_ERROR_OK) {
+            GRAPHIC_LOGW("NotifyControlRing failed");
+        }
+        return;
+    }
+    IpcIo reply;
+    uintptr_t ptr;
+    int32_t ret = Transact(nullptr, sid_, NOTIFY_CONTROL_RING, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    if (ret != SURFACE_ERROR_OK) {
+        GRAPHIC_LOGW("NotifyControlRing failed");
+        return;
+    }
+    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+}
+
+int32_t BufferClientProducer::EnableControlRing()
+{
+    if (controlRing_ != nullptr) {
+        return SURFACE_ERROR_OK;
+    }
+    BufferManager* manager = BufferManager::GetInstance();
+    RETURN_VAL_IF_FAIL(manager, SURFACE_ERROR_NOT_READY);
     IpcIo requestIo;
     uint8_t requestIoData[DEFAULT_IPC_SIZE];
     IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
-    buffer->WriteToIpcIo(requestIo);
     IpcIo reply;
     uintptr_t ptr;
-    ret = Transact(nullptr, sid_, FLUSH_BUFFER, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    int32_t ret = Transact(nullptr, sid_, ENABLE_CONTROL_RING, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
     if (ret != SURFACE_ERROR_OK) {
-        GRAPHIC_LOGW("FlushBuffer failed");
-        return ret;
+        GRAPHIC_LOGW("EnableControlRing Transact failed, errno=%d", ret);
+        return SURFACE_ERROR_SYSTEM_ERROR;
     }
     ret = IpcIoPopInt32(&reply);
-    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
     if (ret != SURFACE_ERROR_OK) {
-        GRAPHIC_LOGW("FlushBuffer failed code=%d", ret);
-        return -1;
+        GRAPHIC_LOGW("EnableControlRing failed code=%d", ret);
+        FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+        return ret;
     }
-    manager->UnmapBuffer(*buffer);
-    delete buffer;
-    return ret;
+    SurfaceBufferImpl replyBuffer;
+    replyBuffer.ReadFromIpcIo(reply);
+    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+    SurfaceBufferImpl* buffer = CreateBuffer(replyBuffer);
+    if (!manager->MapBuffer(*buffer) || buffer->GetVirAddr() == nullptr) {
+        GRAPHIC_LOGW("Map control ring failed");
+        delete buffer;
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    controlBuffer_ = buffer;
+    controlRing_ = static_cast<BufferControlRing*>(buffer->GetVirAddr());
+    return SURFACE_ERROR_OK;
 }
 
 void BufferClientProducer::Cancel(SurfaceBufferImpl* buffer)
@@ -113,6 +384,8 @@ void BufferClientProducer::Cancel(SurfaceBufferImpl* buffer)
     if (buffer == nullptr) {
         return;
     }
+    /* Extra data of a canceled buffer is dropped, so don't carry it. */
+    buffer->ClearExtraData();
     IpcIo requestIo;
     uint8_t requestIoData[DEFAULT_IPC_SIZE];
     IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
@@ -125,6 +398,11 @@ void BufferClientProducer::Cancel(SurfaceBufferImpl* buffer)
     } else {
         FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
     }
+    if (IsCachedBuffer(buffer)) {
+        buffer->SetState(BUFFER_STATE_RELEASE);
+        buffer->ClearExtraData();
+        return;
+    }
     BufferManager* manager = BufferManager::GetInstance();
     RETURN_IF_FAIL(manager);
     manager->UnmapBuffer(*buffer);
@@ -144,29 +422,35 @@ void BufferClientProducer::SetQueueSize(uint8_t queueSize)
         GRAPHIC_LOGW("Set Attr(%d:%u) failed", SET_QUEUE_SIZE, queueSize);
     }
     FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+    InvalidateAttrCache();
 }
 
 uint8_t BufferClientProducer::GetQueueSize()
+{
+    return LoadAttrCache() ? attrCache_.attributes.queueSize : 0;
+}
+
+int32_t BufferClientProducer::Preallocate(bool async)
 {
     IpcIo requestIo;
     uint8_t requestIoData[DEFAULT_IPC_SIZE];
     IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
+    IpcIoPushBool(&requestIo, async);
     IpcIo reply;
     uintptr_t ptr;
-    int32_t ret = Transact(nullptr, sid_, GET_QUEUE_SIZE, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    int32_t ret = Transact(nullptr, sid_, PREALLOCATE, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
     if (ret != SURFACE_ERROR_OK) {
-        GRAPHIC_LOGW("GetAttr Transact failed, errno=%d", ret);
-        return 0;
+        GRAPHIC_LOGW("Preallocate Transact failed, errno=%d", ret);
+        return SURFACE_ERROR_SYSTEM_ERROR;
     }
     ret = IpcIoPopInt32(&reply);
+    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
     if (ret != SURFACE_ERROR_OK) {
-        GRAPHIC_LOGW("GetAttr failed code=%d", GET_QUEUE_SIZE);
-        FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
-        return 0;
+        GRAPHIC_LOGW("Preallocate failed code=%d", ret);
     }
-    uint8_t queueSize = IpcIoPopUint8(&reply);
-    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
-    return queueSize;
+    /* Attaching buffers updates the buffer size and stride. */
+    InvalidateAttrCache();
+    return ret;
 }
 
 void BufferClientProducer::SetWidthAndHeight(uint32_t width, uint32_t height)
@@ -179,22 +463,25 @@ void BufferClientProducer::SetWidthAndHeight(uint32_t width, uint32_t height)
     IpcIo reply;
     uintptr_t ptr;
     int32_t ret = Transact(nullptr, sid_, SET_WIDTH_AND_HEIGHT, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    InvalidateAttrCache();
     if (ret != SURFACE_ERROR_OK) {
         GRAPHIC_LOGW("SetWidthAndHeight failed");
     } else {
         FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+        /* Server resets buffer queue, buffers not held by user will be detached. */
+        ReleaseCachedBuffers(false);
     }
     return;
 }
 
 uint32_t BufferClientProducer::GetWidth()
 {
-    return GetAttr(GET_WIDTH);
+    return LoadAttrCache() ? attrCache_.attributes.width : 0;
 }
 
 uint32_t BufferClientProducer::GetHeight()
 {
-    return GetAttr(GET_HEIGHT);
+    return LoadAttrCache() ? attrCache_.attributes.height : 0;
 }
 
 void BufferClientProducer::SetFormat(uint32_t format)
@@ -204,7 +491,7 @@ void BufferClientProducer::SetFormat(uint32_t format)
 
 uint32_t BufferClientProducer::GetFormat()
 {
-    return GetAttr(GET_FORMAT);
+    return LoadAttrCache() ? attrCache_.attributes.format : 0;
 }
 
 void BufferClientProducer::SetStrideAlignment(uint32_t stride)
@@ -214,12 +501,12 @@ void BufferClientProducer::SetStrideAlignment(uint32_t stride)
 
 uint32_t BufferClientProducer::GetStrideAlignment()
 {
-    return GetAttr(GET_STRIDE_ALIGNMENT);
+    return LoadAttrCache() ? attrCache_.attributes.strideAlignment : 0;
 }
 
 uint32_t BufferClientProducer::GetStride()
 {
-    return GetAttr(GET_STRIDE);
+    return LoadAttrCache() ? attrCache_.attributes.stride : 0;
 }
 
 void BufferClientProducer::SetSize(uint32_t size)
@@ -229,7 +516,7 @@ void BufferClientProducer::SetSize(uint32_t size)
 
 uint32_t BufferClientProducer::GetSize()
 {
-    return GetAttr(GET_SIZE);
+    return LoadAttrCache() ? attrCache_.size : 0;
 }
 
 void BufferClientProducer::SetUsage(uint32_t usage)
@@ -239,8 +526,64 @@ void BufferClientProducer::SetUsage(uint32_t usage)
 
 uint32_t BufferClientProducer::GetUsage()
 {
-    uint32_t usage = GetAttr(GET_USAGE);
-    return usage;
+    return LoadAttrCache() ? attrCache_.attributes.usage : 0;
+}
+
+int32_t BufferClientProducer::SetAttributes(const SurfaceAttributes& attributes)
+{
+    IpcIo requestIo;
+    uint8_t requestIoData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
+    IpcIoPushFlatObj(&requestIo, &attributes, sizeof(SurfaceAttributes));
+    IpcIo reply;
+    uintptr_t ptr;
+    int32_t ret = Transact(nullptr, sid_, SET_ATTRIBUTES, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    if (ret != SURFACE_ERROR_OK) {
+        GRAPHIC_LOGW("SetAttributes Transact failed, errno=%d", ret);
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    ret = IpcIoPopInt32(&reply);
+    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+    InvalidateAttrCache();
+    /* Server resets buffer queue, buffers not held by user will be detached. */
+    ReleaseCachedBuffers(false);
+    return ret;
+}
+
+int32_t BufferClientProducer::GetAttributes(SurfaceAttributes& attributes)
+{
+    if (!LoadAttrCache()) {
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    attributes = attrCache_.attributes;
+    return SURFACE_ERROR_OK;
+}
+
+int32_t BufferClientProducer::GetStats(SurfaceStats& stats)
+{
+    IpcIo requestIo;
+    uint8_t requestIoData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
+    IpcIo reply;
+    uintptr_t ptr;
+    int32_t ret = Transact(nullptr, sid_, GET_STATS, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    if (ret != SURFACE_ERROR_OK) {
+        GRAPHIC_LOGW("GetStats Transact failed, errno=%d", ret);
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    ret = IpcIoPopInt32(&reply);
+    uint32_t size = 0;
+    void* data = IpcIoPopFlatObj(&reply, &size);
+    if (ret == SURFACE_ERROR_OK && (data == nullptr || size != sizeof(SurfaceStats))) {
+        GRAPHIC_LOGW("GetStats reply is invalid, size=%u", size);
+        ret = SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    /* Stats have 64-bit counters, and ipc data has no such alignment, so copy them out. */
+    if (ret == SURFACE_ERROR_OK && memcpy_s(&stats, sizeof(stats), data, size) != EOK) {
+        ret = SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+    return ret;
 }
 
 void BufferClientProducer::SetUserData(const std::string& key, const std::string& value)
@@ -294,33 +637,90 @@ void BufferClientProducer::SetAttr(uint32_t code, uint32_t value)
     IpcIo reply;
     uintptr_t ptr;
     int32_t ret = Transact(nullptr, sid_, code, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    InvalidateAttrCache();
     if (ret != SURFACE_ERROR_OK) {
         GRAPHIC_LOGW("Set Attr(%u:%u) failed", code, value);
     } else {
         FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
+        /* Server resets buffer queue, buffers not held by user will be detached. */
+        ReleaseCachedBuffers(false);
     }
 }
 
-uint32_t BufferClientProducer::GetAttr(uint32_t code)
+bool BufferClientProducer::LoadAttrCache()
 {
+    if (attrCacheValid_) {
+        return true;
+    }
     IpcIo requestIo;
     uint8_t requestIoData[DEFAULT_IPC_SIZE];
     IpcIoInit(&requestIo, requestIoData, DEFAULT_IPC_SIZE, 0);
     IpcIo reply;
     uintptr_t ptr;
-    int32_t ret = Transact(nullptr, sid_, code, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
+    int32_t ret = Transact(nullptr, sid_, GET_ATTRIBUTES, &requestIo, &reply, LITEIPC_FLAG_DEFAULT, &ptr);
     if (ret != SURFACE_ERROR_OK) {
-        GRAPHIC_LOGW("GetAttr Transact failed, errno=%d", ret);
-        return 0;
+        GRAPHIC_LOGW("GetAttributes Transact failed, errno=%d", ret);
+        return false;
     }
     ret = IpcIoPopInt32(&reply);
-    if (ret != SURFACE_ERROR_OK) {
-        GRAPHIC_LOGW("GetAttr failed code=%d", code);
-        FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
-        return 0;
+    uint32_t size = 0;
+    void* data = IpcIoPopFlatObj(&reply, &size);
+    if (ret == SURFACE_ERROR_OK && data != nullptr && size == sizeof(BufferAttrSnapshot)) {
+        StoreAttrCache(*static_cast<BufferAttrSnapshot*>(data));
+    } else {
+        GRAPHIC_LOGW("GetAttributes reply is invalid, code=%d, size=%u", ret, size);
     }
-    uint32_t attr = IpcIoPopUint32(&reply);
     FreeBuffer(nullptr, reinterpret_cast<void *>(ptr));
-    return attr;
+    return attrCacheValid_;
+}
+
+void BufferClientProducer::UpdateAttrCache(IpcIo& reply)
+{
+    uint32_t sequence = IpcIoPopUint32(&reply);
+    if (attrCacheValid_ && sequence == attrCache_.sequence) {
+        return;
+    }
+    uint32_t size = 0;
+    void* data = IpcIoPopFlatObj(&reply, &size);
+    if (data == nullptr || size != sizeof(BufferAttrSnapshot)) {
+        InvalidateAttrCache();
+        return;
+    }
+    StoreAttrCache(*static_cast<BufferAttrSnapshot*>(data));
+}
+
+void BufferClientProducer::StoreAttrCache(const BufferAttrSnapshot& snapshot)
+{
+    attrCache_ = snapshot;
+    attrCacheValid_ = true;
+    if (snapshot.resetSequence != resetSeq_) {
+        /* Queue is reset by consumer, buffers not held by user are detached, drop their mappings. */
+        resetSeq_ = snapshot.resetSequence;
+        ReleaseCachedBuffers(false);
+    }
+}
+
+void BufferClientProducer::UpdateAsyncFlushError(IpcIo& reply)
+{
+    int32_t error = IpcIoPopInt32(&reply);
+    if (error != SURFACE_ERROR_OK) {
+        GRAPHIC_LOGW("Async flush buffer failed code=%d", error);
+        asyncFlushError_.store(error);
+    }
+}
+
+void BufferClientProducer::SetAsyncFlushMode(bool enable)
+{
+    asyncFlush_ = enable;
+}
+
+int32_t BufferClientProducer::GetAsyncFlushError()
+{
+    return asyncFlushError_.exchange(SURFACE_ERROR_OK);
+}
+
+void BufferClientProducer::InvalidateAttrCache()
+{
+    attrCacheValid_ = false;
 }
 } // end namespace
@@ -16,6 +16,7 @@
 #ifndef GRAPHIC_LITE_BUFFER_CLIENT_PRODUCER_H
 #define GRAPHIC_LITE_BUFFER_CLIENT_PRODUCER_H
 
+#include <atomic>
 #include "buffer_producer.h"
 #include "buffer_queue.h"
 #include "liteipc_adapter.h"
@@ -25,6 +26,9 @@ namespace OHOS {
 /**
  * @brief Surface producer client class in multi process. Surface Client invoke these method to send ipc
  *        request to BufferQueueProducer for request buffer, flush buffer, cancel buffer and set buffer attr.
+ *        Mapped buffers are cached by buffer queue slot, and remapped only when the slot holds another buffer.
+ *        With control ring enabled, buffers are requested and flushed through shared memory, ipc request is only
+ *        sent to notify consumer, to wait for free buffers and to map new buffers.
  */
 class BufferClientProducer : public BufferProducer {
 public:
@@ -50,6 +54,15 @@ public:
      */
     SurfaceBufferImpl* RequestBuffer(uint8_t wait) override;
 
+    /**
+     * @brief Request buffer. Surface client producer sends ipc message(code=REQUEST_BUFFER_TIMEOUT) to requests
+     *        buffer, the server side waits at most timeout nanoseconds when wait is set.
+     * @param [in] whether waiting or not.
+     * @param [in] timeout, the longest time to wait in nanoseconds. A negative value waits forever.
+     * @returns buffer pointer.
+     */
+    SurfaceBufferImpl* RequestBuffer(uint8_t wait, int64_t timeout) override;
+
     /**
      * @brief Flush buffer for consumer acquire. Client producer sends request(code=FLUSH_BUFFER) to flush buffer,
      *        BufferQueueProducer push buffer to dirty list, and call back to consumer that buffer is available to
@@ -79,6 +92,14 @@ public:
      */
     uint8_t GetQueueSize() override;
 
+    /**
+     * @brief Preallocate buffers. Surface client producer sends ipc message(code=PREALLOCATE),
+     *        BufferQueueProducer allocates buffers until the allocated buffer count reaches queue size.
+     * @param [in] async, whether allocate buffers in a background thread of the consumer process.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t Preallocate(bool async) override;
+
     /**
      * @brief Client Producer sends request(SET_WIDTH_AND_HEIGHT) to set width and height to calculate the buffer size.
      * @param [in] width, Buffer width.
@@ -161,6 +182,29 @@ public:
      */
     uint32_t GetUsage() override;
 
+    /**
+     * @brief Set all buffer attributes. Surface client producer sends ipc message(code=SET_ATTRIBUTES)
+     *        with all attributes, buffer queue resets once for all changed attributes.
+     * @param [in] The buffer attributes, stride is ignored.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t SetAttributes(const SurfaceAttributes& attributes) override;
+
+    /**
+     * @brief Get all buffer attributes. Surface client producer sends ipc message(code=GET_ATTRIBUTES)
+     *        and gets all attributes in one reply.
+     * @param [out] The buffer attributes.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t GetAttributes(SurfaceAttributes& attributes) override;
+
+    /**
+     * @brief Get the counters of buffer queue. Surface client producer sends ipc message(code=GET_STATS).
+     * @param [out] stats, the counters.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t GetStats(SurfaceStats& stats) override;
+
     /**
      * @brief Set user data. Construct a local map to store all the user-data.
      * @param [in] key.
@@ -174,10 +218,53 @@ public:
      */
     std::string GetUserData(const std::string& key) override;
 
+    /**
+     * @brief Enable control ring. Client producer sends request(code=ENABLE_CONTROL_RING) once to map the control
+     *        ring shared with buffer queue, then requests free buffers from it and pushes flushed buffers to it.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t EnableControlRing();
+
+    /**
+     * @brief Set asynchronous flush mode. Client producer sends one-way request(code=FLUSH_BUFFER_ASYNC) to flush
+     *        buffer and returns without waiting for consumer. The error of a failed flush comes back with the reply
+     *        of the next request buffer ipc.
+     * @param [in] enable, whether asynchronous flush mode is enabled.
+     */
+    void SetAsyncFlushMode(bool enable);
+
+    /**
+     * @brief Get the error of the last failed asynchronous flush, and clear it.
+     * @returns The flush error, 0 if no asynchronous flush failed.
+     */
+    int32_t GetAsyncFlushError();
+
 private:
-    uint32_t GetAttr(uint32_t code);
+    SurfaceBufferImpl* RequestBufferByCode(uint32_t code, IpcIo& requestIo);
+    SurfaceBufferImpl* TransactRequestBuffer(uint32_t code, IpcIo& requestIo);
+    SurfaceBufferImpl* CreateBuffer(SurfaceBufferImpl& replyBuffer);
+    SurfaceBufferImpl* RequestBufferFromRing();
+    int32_t TransactFlushBuffer(SurfaceBufferImpl* buffer);
+    bool FlushBufferToRing(SurfaceBufferImpl* buffer);
+    void NotifyControlRing(bool needReply);
+    SurfaceBufferImpl* GetCachedBuffer(SurfaceBufferImpl& replyBuffer);
+    bool IsCachedBuffer(const SurfaceBufferImpl* buffer) const;
+    void ReleaseCachedBuffers(bool force);
+    bool LoadAttrCache();
+    void UpdateAttrCache(IpcIo& reply);
+    void StoreAttrCache(const BufferAttrSnapshot& snapshot);
+    void UpdateAsyncFlushError(IpcIo& reply);
+    void InvalidateAttrCache();
     void SetAttr(uint32_t code, uint32_t value);
     SvcIdentity sid_;
+    SurfaceBufferImpl* cachedBuffers_[BUFFER_QUEUE_SLOT_COUNT];
+    BufferAttrSnapshot attrCache_;
+    bool attrCacheValid_;
+    uint32_t resetSeq_;
+    SurfaceBufferImpl* controlBuffer_;
+    BufferControlRing* controlRing_;
+    bool asyncFlush_;
+    std::atomic<int32_t> asyncFlushError_;
 };
 } // end namespace
 
@@ -15,11 +15,42 @@
 
 #include "buffer_manager.h"
 
+#include <iterator>
+
 #include "buffer_common.h"
 #include "securec.h"
+#include "soft_gralloc.h"
 #include "surface_buffer.h"
 
 namespace OHOS {
+const uint32_t BUFFER_POOL_BUDGET_DEFAULT = 0; // disabled until the process sets a budget
+
+BufferManager::BufferManager()
+    : grallocFucs_(nullptr),
+      poolBudget_(BUFFER_POOL_BUDGET_DEFAULT),
+      poolBytes_(0)
+{
+    for (uint8_t i = 0; i < BUFFER_HANDLE_SHARD_COUNT; i++) {
+        pthread_mutex_init(&bufferHandleShards_[i].lock, nullptr);
+    }
+    pthread_mutex_init(&poolLock_, nullptr);
+    pthread_mutex_init(&initLock_, nullptr);
+}
+
+BufferManager::~BufferManager()
+{
+    for (uint8_t i = 0; i < BUFFER_HANDLE_SHARD_COUNT; i++) {
+        pthread_mutex_destroy(&bufferHandleShards_[i].lock);
+    }
+    pthread_mutex_destroy(&poolLock_);
+    pthread_mutex_destroy(&initLock_);
+}
+
+BufferManager::BufferHandleShard& BufferManager::GetShard(const BufferKey& key)
+{
+    return bufferHandleShards_[BufferKeyHash()(key) % BUFFER_HANDLE_SHARD_COUNT];
+}
+
 BufferManager* BufferManager::GetInstance()
 {
     static BufferManager instance;
@@ -28,13 +59,35 @@ BufferManager* BufferManager::GetInstance()
 
 bool BufferManager::Init()
 {
+    pthread_mutex_lock(&initLock_);
     if (grallocFucs_ != nullptr) {
+        pthread_mutex_unlock(&initLock_);
         GRAPHIC_LOGI("BufferManager has init succeed.");
         return true;
     }
+#ifdef SURFACE_SOFT_GRALLOC
+    if (SoftGrallocInitialize(&grallocFucs_) != DISPLAY_SUCCESS) {
+#else
     if (GrallocInitialize(&grallocFucs_) != DISPLAY_SUCCESS) {
+#endif
+        pthread_mutex_unlock(&initLock_);
+        return false;
+    }
+    pthread_mutex_unlock(&initLock_);
+    return true;
+}
+
+bool BufferManager::Init(GrallocFuncs* grallocFuncs)
+{
+    RETURN_VAL_IF_FAIL(grallocFuncs, false);
+    pthread_mutex_lock(&initLock_);
+    if (grallocFucs_ != nullptr && grallocFucs_ != grallocFuncs) {
+        pthread_mutex_unlock(&initLock_);
+        GRAPHIC_LOGW("BufferManager has init with another allocator.");
         return false;
     }
+    grallocFucs_ = grallocFuncs;
+    pthread_mutex_unlock(&initLock_);
     return true;
 }
 
@@ -119,11 +172,114 @@ BufferHandle* BufferManager::AllocateBufferHandle(SurfaceBufferImpl& buffer) con
     return nullptr;
 }
 
+static bool IsSameAllocInfo(const AllocInfo& info, const AllocInfo& other)
+{
+    return info.width == other.width && info.height == other.height && info.usage == other.usage &&
+        info.format == other.format && info.expectedSize == other.expectedSize;
+}
+
+BufferHandle* BufferManager::TakeFromPool(const AllocInfo& info)
+{
+    pthread_mutex_lock(&poolLock_);
+    for (auto iter = pool_.begin(); iter != pool_.end(); ++iter) {
+        if (IsSameAllocInfo(iter->info, info)) {
+            BufferHandle* bufferHandle = iter->handle;
+            poolBytes_ -= static_cast<uint32_t>(bufferHandle->size);
+            pool_.erase(iter);
+            pthread_mutex_unlock(&poolLock_);
+            GRAPHIC_LOGD("Reuse buffer from recycle pool.");
+            ClearPooledBuffer(bufferHandle, info);
+            return bufferHandle;
+        }
+    }
+    pthread_mutex_unlock(&poolLock_);
+    return nullptr;
+}
+
+void BufferManager::ClearPooledBuffer(BufferHandle* bufferHandle, const AllocInfo& info) const
+{
+    /* The new owner may be another surface shared with another process, do not hand over the old pixels. */
+    if (bufferHandle->virAddr == nullptr || bufferHandle->size <= 0) {
+        return;
+    }
+    uint32_t size = static_cast<uint32_t>(bufferHandle->size);
+    if (memset_s(bufferHandle->virAddr, size, 0, size) != EOK) {
+        GRAPHIC_LOGW("Clear pooled buffer failed.");
+        return;
+    }
+    if (((info.usage & HBM_USE_MEM_MMZ_CACHE) != 0) && (grallocFucs_->FlushCache != nullptr) &&
+        (grallocFucs_->FlushCache(bufferHandle) != DISPLAY_SUCCESS)) {
+        GRAPHIC_LOGW("Flush pooled buffer failed.");
+    }
+}
+
+void BufferManager::PutToPool(BufferHandle* bufferHandle, const AllocInfo& info)
+{
+    std::list<AllocatedBuffer> evicted;
+    pthread_mutex_lock(&poolLock_);
+    if (static_cast<uint32_t>(bufferHandle->size) > poolBudget_) {
+        pthread_mutex_unlock(&poolLock_);
+        grallocFucs_->FreeMem(bufferHandle);
+        return;
+    }
+    /* Most recently freed buffer is at the front, evict from the back. */
+    pool_.push_front({bufferHandle, info});
+    poolBytes_ += static_cast<uint32_t>(bufferHandle->size);
+    TrimPool(poolBudget_, evicted);
+    pthread_mutex_unlock(&poolLock_);
+    FreeEvicted(evicted);
+}
+
+void BufferManager::TrimPool(uint32_t budget, std::list<AllocatedBuffer>& evicted)
+{
+    while (poolBytes_ > budget && !pool_.empty()) {
+        poolBytes_ -= static_cast<uint32_t>(pool_.back().handle->size);
+        evicted.splice(evicted.begin(), pool_, std::prev(pool_.end()));
+    }
+}
+
+void BufferManager::FreeEvicted(std::list<AllocatedBuffer>& evicted)
+{
+    for (auto iter = evicted.begin(); iter != evicted.end(); ++iter) {
+        grallocFucs_->FreeMem(iter->handle);
+    }
+    evicted.clear();
+}
+
+void BufferManager::SetPoolBudget(uint32_t budget)
+{
+    std::list<AllocatedBuffer> evicted;
+    pthread_mutex_lock(&poolLock_);
+    poolBudget_ = budget;
+    if ((grallocFucs_ != nullptr) && (grallocFucs_->FreeMem != nullptr)) {
+        TrimPool(budget, evicted);
+    }
+    pthread_mutex_unlock(&poolLock_);
+    FreeEvicted(evicted);
+}
+
+BufferHandle* BufferManager::GetBufferHandle(SurfaceBufferImpl& buffer) const
+{
+    BufferHandle* bufferHandle = static_cast<BufferHandle *>(buffer.GetBufferHandle());
+    if (bufferHandle == nullptr) {
+        bufferHandle = AllocateBufferHandle(buffer);
+        if (bufferHandle == nullptr) {
+            return nullptr;
+        }
+        buffer.SetBufferHandle(bufferHandle);
+    }
+    /* Virtual address and data size change between calls, refresh them. */
+    bufferHandle->virAddr = buffer.GetVirAddr();
+    bufferHandle->size = buffer.GetSize();
+    return bufferHandle;
+}
+
 SurfaceBufferImpl* BufferManager::AllocBuffer(AllocInfo info)
 {
     RETURN_VAL_IF_FAIL((grallocFucs_ != nullptr), nullptr);
-    BufferHandle* bufferHandle = nullptr;
-    if ((grallocFucs_->AllocMem == nullptr) || (grallocFucs_->AllocMem(&info, &bufferHandle) != DISPLAY_SUCCESS)) {
+    BufferHandle* bufferHandle = TakeFromPool(info);
+    if ((bufferHandle == nullptr) && ((grallocFucs_->AllocMem == nullptr) ||
+        (grallocFucs_->AllocMem(&info, &bufferHandle) != DISPLAY_SUCCESS))) {
         GRAPHIC_LOGE("Alloc graphic buffer failed");
         return nullptr;
     }
@@ -140,7 +296,11 @@ SurfaceBufferImpl* BufferManager::AllocBuffer(AllocInfo info)
             buffer->SetInt32(i, bufferHandle->reserve[i]);
         }
         BufferKey key = {bufferHandle->key, bufferHandle->phyAddr};
-        bufferHandleMap_.insert(std::make_pair(key, bufferHandle));
+        AllocatedBuffer allocated = {bufferHandle, info};
+        BufferHandleShard& shard = GetShard(key);
+        pthread_mutex_lock(&shard.lock);
+        shard.map.insert(std::make_pair(key, allocated));
+        pthread_mutex_unlock(&shard.lock);
         GRAPHIC_LOGD("Alloc buffer succeed to shared memory segment.");
     } else {
         grallocFucs_->FreeMem(bufferHandle);
@@ -200,25 +360,27 @@ void BufferManager::FreeBuffer(SurfaceBufferImpl** buffer)
         return;
     }
     BufferKey key = {(*buffer)->GetKey(), (*buffer)->GetPhyAddr()};
-    auto iter = bufferHandleMap_.find(key);
-    if (iter == bufferHandleMap_.end()) {
+    BufferHandleShard& shard = GetShard(key);
+    pthread_mutex_lock(&shard.lock);
+    auto iter = shard.map.find(key);
+    if (iter == shard.map.end() || grallocFucs_->FreeMem == nullptr) {
+        pthread_mutex_unlock(&shard.lock);
         return;
     }
-    BufferHandle* bufferHandle = iter->second;
-    if (grallocFucs_->FreeMem != nullptr) {
-        grallocFucs_->FreeMem(bufferHandle);
-        bufferHandleMap_.erase(key);
-        delete *buffer;
-        *buffer = nullptr;
-        GRAPHIC_LOGD("Free buffer succeed.");
-    }
+    AllocatedBuffer allocated = iter->second;
+    shard.map.erase(iter);
+    pthread_mutex_unlock(&shard.lock);
+    PutToPool(allocated.handle, allocated.info);
+    delete *buffer;
+    *buffer = nullptr;
+    GRAPHIC_LOGD("Free buffer succeed.");
 }
 
 bool BufferManager::MapBuffer(SurfaceBufferImpl& buffer) const
 {
     RETURN_VAL_IF_FAIL((grallocFucs_ != nullptr), false);
     void* virAddr = nullptr;
-    BufferHandle* bufferHandle = AllocateBufferHandle(buffer);
+    BufferHandle* bufferHandle = GetBufferHandle(buffer);
     if (bufferHandle == nullptr) {
         return false;
     }
@@ -234,37 +396,33 @@ bool BufferManager::MapBuffer(SurfaceBufferImpl& buffer) const
         }
     } else {
         GRAPHIC_LOGE("No support usage.");
-        free(bufferHandle);
         return false;
     }
     if (virAddr == nullptr) {
         GRAPHIC_LOGE("Map Buffer error.");
-        free(bufferHandle);
         return false;
     }
     buffer.SetVirAddr(virAddr);
     GRAPHIC_LOGD("Map Buffer succeed.");
-    free(bufferHandle);
     return true;
 }
 
 void BufferManager::UnmapBuffer(SurfaceBufferImpl& buffer) const
 {
     RETURN_IF_FAIL((grallocFucs_ != nullptr));
-    BufferHandle* bufferHandle = AllocateBufferHandle(buffer);
+    BufferHandle* bufferHandle = GetBufferHandle(buffer);
     if (bufferHandle == nullptr) {
         return;
     }
     if ((grallocFucs_->Unmap == nullptr) || (grallocFucs_->Unmap(bufferHandle) != DISPLAY_SUCCESS)) {
         GRAPHIC_LOGE("Umap buffer failed.");
     }
-    free(bufferHandle);
 }
 
 int32_t BufferManager::FlushCache(SurfaceBufferImpl& buffer) const
 {
     RETURN_VAL_IF_FAIL((grallocFucs_ != nullptr), SURFACE_ERROR_NOT_READY);
-    BufferHandle* bufferHandle = AllocateBufferHandle(buffer);
+    BufferHandle* bufferHandle = GetBufferHandle(buffer);
     if (bufferHandle == nullptr) {
         return -1;
     }
@@ -277,7 +435,6 @@ int32_t BufferManager::FlushCache(SurfaceBufferImpl& buffer) const
             GRAPHIC_LOGE("Flush M cache buffer failed.");
         }
     }
-    free(bufferHandle);
     return SURFACE_ERROR_OK;
 }
 } // namespace OHOS
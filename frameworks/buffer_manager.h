@@ -16,7 +16,9 @@
 #ifndef GRAPHIC_LITE_BUFFER_MANAGER_H
 #define GRAPHIC_LITE_BUFFER_MANAGER_H
 
-#include <map>
+#include <list>
+#include <pthread.h>
+#include <unordered_map>
 #include "display_gralloc.h"
 #include "surface_buffer_impl.h"
 #include "surface_type.h"
@@ -36,11 +38,20 @@ public:
     static BufferManager* GetInstance();
 
     /**
-     * @brief Buffer Manager Init.
+     * @brief Buffer Manager Init with the default allocator backend, which is the vendor gralloc, or the software
+     *        gralloc when built with SURFACE_SOFT_GRALLOC.
      * @returns Whether Buffer manager init succeed or not.
      */
     bool Init();
 
+    /**
+     * @brief Buffer Manager Init with the given allocator backend. Call it before any other init.
+     * @param [in] grallocFuncs, the allocator functions, AllocMem, FreeMem, Mmap, MmapCache, Unmap, FlushCache
+     *        and FlushMCache are used.
+     * @returns false if buffer manager has init with another backend.
+     */
+    bool Init(GrallocFuncs* grallocFuncs);
+
     /**
      * @brief Allocate buffer for producer.
      * @param [in] size, alloc buffer size.
@@ -85,26 +96,64 @@ public:
      */
     void UnmapBuffer(SurfaceBufferImpl& buffer) const;
 
+    /**
+     * @brief Set the byte budget of the recycle pool. Freed buffers are kept in the pool and reused by a later
+     *        allocation with the same attributes, the least recently freed ones are released when the pool
+     *        exceeds the budget. Pooled memory stays resident in the process, so the pool is disabled by default.
+     *        A reused buffer is cleared to zero before it is handed out.
+     * @param [in] budget, the max bytes of buffers kept in the pool, 0 disables the pool.
+     */
+    void SetPoolBudget(uint32_t budget);
+
 protected:
     BufferHandle* AllocateBufferHandle(SurfaceBufferImpl& buffer) const;
+    BufferHandle* GetBufferHandle(SurfaceBufferImpl& buffer) const;
     SurfaceBufferImpl* AllocBuffer(AllocInfo info);
     bool ConvertUsage(uint64_t& destUsage, uint32_t srcUsage) const;
     bool ConvertFormat(PixelFormat& destFormat, uint32_t srcFormat) const;
+    BufferHandle* TakeFromPool(const AllocInfo& info);
+    void PutToPool(BufferHandle* bufferHandle, const AllocInfo& info);
+    void ClearPooledBuffer(BufferHandle* bufferHandle, const AllocInfo& info) const;
 
 private:
-    BufferManager() : grallocFucs_(nullptr) {}
-    ~BufferManager() {}
+    BufferManager();
+    ~BufferManager();
 
-    GrallocFuncs* grallocFucs_;
+    const static uint8_t BUFFER_HANDLE_SHARD_COUNT = 8;
+    struct AllocatedBuffer {
+        BufferHandle* handle;
+        AllocInfo info;
+    };
     struct BufferKey {
         int32_t key;
         uint64_t phyAddr;
-        bool operator< (const BufferKey &x) const
+        bool operator== (const BufferKey &x) const
+        {
+            return key == x.key && phyAddr == x.phyAddr;
+        }
+    };
+    struct BufferKeyHash {
+        size_t operator() (const BufferKey &x) const
         {
-            return (key < x.key) || (key == x.key && phyAddr < x.phyAddr);
+            return static_cast<size_t>(x.phyAddr ^ (static_cast<uint64_t>(static_cast<uint32_t>(x.key)) * 31));
         }
     };
-    std::map<BufferKey, BufferHandle*> bufferHandleMap_;
+    /* Buffers are spread to shards by key hash, each shard has its own lock. */
+    struct BufferHandleShard {
+        pthread_mutex_t lock;
+        std::unordered_map<BufferKey, AllocatedBuffer, BufferKeyHash> map;
+    };
+    BufferHandleShard& GetShard(const BufferKey& key);
+    void TrimPool(uint32_t budget, std::list<AllocatedBuffer>& evicted);
+    void FreeEvicted(std::list<AllocatedBuffer>& evicted);
+
+    pthread_mutex_t initLock_;
+    GrallocFuncs* grallocFucs_;
+    BufferHandleShard bufferHandleShards_[BUFFER_HANDLE_SHARD_COUNT];
+    pthread_mutex_t poolLock_;
+    std::list<AllocatedBuffer> pool_;
+    uint32_t poolBudget_;
+    uint32_t poolBytes_;
 };
 } // end namespace
 #endif
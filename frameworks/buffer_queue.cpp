@@ -15,7 +15,8 @@
 
 #include "buffer_queue.h"
 
-#include <list>
+#include <cerrno>
+#include <new>
 #include <string>
 
 #include "buffer_common.h"
@@ -27,6 +28,56 @@ const uint8_t BUFFER_QUEUE_SIZE_DEFAULT = 1;
 const uint8_t BUFFER_QUEUE_SIZE_MAX = 10;
 const int32_t BUFFER_CONSUMER_USAGE_DEFAULT = BUFFER_CONSUMER_USAGE_SORTWARE;
 const uint8_t USER_DATA_COUNT = 100;
+const int64_t NSEC_PER_SEC = 1000000000;
+const int64_t NSEC_PER_USEC = 1000;
+const int64_t USEC_PER_SEC = 1000000;
+
+static void InitLatency(BufferLatencyHistogram& histogram)
+{
+    histogram.count = 0;
+    for (uint8_t i = 0; i < SURFACE_LATENCY_BUCKET_COUNT; i++) {
+        histogram.buckets[i] = 0;
+    }
+    histogram.totalUs = 0;
+    histogram.maxUs = 0;
+}
+
+static void InitStats(BufferQueueStats& stats)
+{
+    stats.waitUs = 0;
+    stats.requestSucceeded = 0;
+    stats.requestFailed = 0;
+    stats.waits = 0;
+    stats.flushes = 0;
+    stats.acquires = 0;
+    stats.emptyAcquires = 0;
+    stats.allocs = 0;
+    stats.frees = 0;
+    stats.deletePendingDetaches = 0;
+    stats.peakFreeDepth = 0;
+    stats.peakDirtyDepth = 0;
+    stats.lockContentions = 0;
+    stats.lockWaitUs = 0;
+}
+
+static inline void CountStat(std::atomic<uint32_t>& counter)
+{
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void UpdatePeak(std::atomic<uint32_t>& peak, uint32_t depth)
+{
+    uint32_t current = peak.load(std::memory_order_relaxed);
+    while (depth > current && !peak.compare_exchange_weak(current, depth, std::memory_order_relaxed)) {
+    }
+}
+
+static uint64_t GetMonotonicUs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * USEC_PER_SEC + now.tv_nsec / NSEC_PER_USEC;
+}
 
 BufferQueue::BufferQueue()
     : width_(0),
@@ -38,28 +89,61 @@ BufferQueue::BufferQueue()
       queueSize_(BUFFER_QUEUE_SIZE_DEFAULT),
       strideAlignment_(BUFFER_STRIDE_ALIGNMENT_DEFAULT),
       attachCount_(0),
-      customSize_(false)
+      customSize_(false),
+      usedSlotCount_(0),
+      lockFree_(false),
+      mailbox_(false),
+      preallocateStarted_(false),
+      resetSeq_(0),
+      freeWaiters_(0),
+      attrSeq_(1),
+      controlBuffer_(nullptr),
+      controlRing_(nullptr),
+      requestWaiters_(0)
 {
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        slots_[i] = {nullptr, nullptr, 0, 0, 0, BUFFER_SLOT_INVALID, BUFFER_SLOT_INVALID};
+    }
+    InitLatency(latency_.producerHold);
+    InitLatency(latency_.queueDwell);
+    InitLatency(latency_.consumerHold);
+    InitLatency(latency_.requestWait);
+    InitStats(stats_);
+    freeList_ = {BUFFER_SLOT_INVALID, BUFFER_SLOT_INVALID, 0};
+    dirtyList_ = {BUFFER_SLOT_INVALID, BUFFER_SLOT_INVALID, 0};
+    cancelList_ = {BUFFER_SLOT_INVALID, BUFFER_SLOT_INVALID, 0};
+    freeRing_.head = 0;
+    freeRing_.tail = 0;
+    dirtyRing_.head = 0;
+    dirtyRing_.tail = 0;
 }
 
 BufferQueue::~BufferQueue()
 {
-    pthread_mutex_lock(&lock_);
-    freeList_.clear();
-    dirtyList_.clear();
-    std::list<SurfaceBufferImpl *>::iterator iterBuffer;
-    for (iterBuffer = allBuffers_.begin(); iterBuffer != allBuffers_.end(); ++iterBuffer) {
-        SurfaceBufferImpl* tmpBuffer = *iterBuffer;
-        BufferManager* bufferManager = BufferManager::GetInstance();
-        if (bufferManager == nullptr) {
+    pthread_mutex_lock(&preallocateLock_);
+    JoinPreallocateThread();
+    pthread_mutex_unlock(&preallocateLock_);
+    Lock();
+    BufferManager* bufferManager = BufferManager::GetInstance();
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        SurfaceBufferImpl* tmpBuffer = slots_[i].buffer;
+        if (tmpBuffer == nullptr) {
             continue;
         }
-        bufferManager->FreeBuffer(&tmpBuffer);
+        FreeSlot(i);
+        if (bufferManager != nullptr) {
+            bufferManager->FreeBuffer(&tmpBuffer);
+        }
+    }
+    if (controlBuffer_ != nullptr && bufferManager != nullptr) {
+        controlRing_->~BufferControlRing();
+        controlRing_ = nullptr;
+        bufferManager->FreeBuffer(&controlBuffer_);
     }
-    allBuffers_.clear();
     pthread_mutex_unlock(&lock_);
     pthread_cond_destroy(&freeCond_);
     pthread_mutex_destroy(&lock_);
+    pthread_mutex_destroy(&preallocateLock_);
 }
 
 bool BufferQueue::Init()
@@ -68,26 +152,212 @@ bool BufferQueue::Init()
         GRAPHIC_LOGE("Failed init mutex");
         return false;
     }
-    if (pthread_cond_init(&freeCond_, NULL)) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    /* Timed requests compute deadlines on the monotonic clock, so wall clock changes do not affect them. */
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&freeCond_, &attr)) {
         GRAPHIC_LOGE("Failed init cond");
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_destroy(&lock_);
+        return false;
+    }
+    pthread_condattr_destroy(&attr);
+    if (pthread_mutex_init(&preallocateLock_, NULL)) {
+        GRAPHIC_LOGE("Failed init preallocate mutex");
+        pthread_cond_destroy(&freeCond_);
         pthread_mutex_destroy(&lock_);
         return false;
     }
     return true;
 }
 
-void BufferQueue::NeedAttach()
+static void GetDeadline(int64_t timeout, struct timespec& deadline)
 {
-    if (queueSize_ == attachCount_) {
-        GRAPHIC_LOGI("has alloced %d buffer, could not alloc more.", allBuffers_.size());
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    int64_t nsec = deadline.tv_nsec + timeout % NSEC_PER_SEC;
+    deadline.tv_sec += timeout / NSEC_PER_SEC + nsec / NSEC_PER_SEC;
+    deadline.tv_nsec = nsec % NSEC_PER_SEC;
+}
+
+void BufferQueue::Lock()
+{
+    /* Read the clock only when the lock is held by another thread. */
+    if (pthread_mutex_trylock(&lock_) == 0) {
         return;
     }
+    uint64_t startUs = GetMonotonicUs();
+    pthread_mutex_lock(&lock_);
+    CountStat(stats_.lockContentions);
+    stats_.lockWaitUs.fetch_add(GetMonotonicUs() - startUs, std::memory_order_relaxed);
+}
+
+bool BufferQueue::WaitFreeBuffer(const struct timespec* deadline)
+{
+    uint64_t startUs = GetMonotonicUs();
+    bool woken = true;
+    if (deadline == nullptr) {
+        pthread_cond_wait(&freeCond_, &lock_);
+    } else {
+        woken = pthread_cond_timedwait(&freeCond_, &lock_, deadline) != ETIMEDOUT;
+    }
+    CountStat(stats_.waits);
+    stats_.waitUs.fetch_add(GetMonotonicUs() - startUs, std::memory_order_relaxed);
+    return woken;
+}
+
+uint8_t BufferQueue::AllocSlot(SurfaceBufferImpl* buffer)
+{
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        if (slots_[i].buffer == nullptr) {
+            slots_[i].buffer = buffer;
+            slots_[i].generation++;
+            buffer->SetSlot(i, slots_[i].generation);
+            usedSlotCount_++;
+            return i;
+        }
+    }
+    return BUFFER_SLOT_INVALID;
+}
+
+uint8_t BufferQueue::FindSlot(const SurfaceBufferImpl* buffer) const
+{
+    uint8_t slot = buffer->GetSlot();
+    if (slot >= BUFFER_QUEUE_SLOT_COUNT || slots_[slot].buffer != buffer) {
+        return BUFFER_SLOT_INVALID;
+    }
+    return slot;
+}
+
+void BufferQueue::FreeSlot(uint8_t slot)
+{
+    RemoveSlot(slot);
+    slots_[slot].buffer = nullptr;
+    usedSlotCount_--;
+}
+
+void BufferQueue::PushSlot(BufferSlotList& list, uint8_t slot)
+{
+    BufferSlot& node = slots_[slot];
+    node.owner = &list;
+    node.prev = list.tail;
+    node.next = BUFFER_SLOT_INVALID;
+    if (list.tail != BUFFER_SLOT_INVALID) {
+        slots_[list.tail].next = slot;
+    } else {
+        list.head = slot;
+    }
+    list.tail = slot;
+    list.count++;
+    if (&list == &freeList_) {
+        UpdatePeak(stats_.peakFreeDepth, list.count);
+    } else if (&list == &dirtyList_) {
+        UpdatePeak(stats_.peakDirtyDepth, list.count);
+    }
+}
+
+uint8_t BufferQueue::PopSlot(BufferSlotList& list)
+{
+    uint8_t slot = list.head;
+    if (slot != BUFFER_SLOT_INVALID) {
+        RemoveSlot(slot);
+    }
+    return slot;
+}
+
+void BufferQueue::RemoveSlot(uint8_t slot)
+{
+    BufferSlot& node = slots_[slot];
+    BufferSlotList* list = node.owner;
+    if (list == nullptr) {
+        return;
+    }
+    if (node.prev != BUFFER_SLOT_INVALID) {
+        slots_[node.prev].next = node.next;
+    } else {
+        list->head = node.next;
+    }
+    if (node.next != BUFFER_SLOT_INVALID) {
+        slots_[node.next].prev = node.prev;
+    } else {
+        list->tail = node.prev;
+    }
+    list->count--;
+    node.owner = nullptr;
+    node.prev = BUFFER_SLOT_INVALID;
+    node.next = BUFFER_SLOT_INVALID;
+}
+
+void BufferQueue::PushRing(BufferSlotRing& ring, uint8_t slot)
+{
+    uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+    ring.slots[tail & BUFFER_RING_MASK] = slot;
+    ring.tail.store(tail + 1);
+    UpdatePeak((&ring == &freeRing_) ? stats_.peakFreeDepth : stats_.peakDirtyDepth, tail + 1 - ring.head.load());
+}
+
+uint8_t BufferQueue::PopRing(BufferSlotRing& ring)
+{
+    uint32_t head = ring.head.load(std::memory_order_relaxed);
+    if (head == ring.tail.load()) {
+        return BUFFER_SLOT_INVALID;
+    }
+    uint8_t slot = ring.slots[head & BUFFER_RING_MASK];
+    ring.head.store(head + 1);
+    return slot;
+}
+
+bool BufferQueue::PushControlEntry(BufferControlQueue& queue, const BufferControlEntry& entry)
+{
+    uint32_t tail = queue.tail.load(std::memory_order_relaxed);
+    /* The queue is in memory shared with another process, a corrupted one is treated as full. */
+    if (tail - queue.head.load() >= BUFFER_QUEUE_SLOT_COUNT) {
+        return false;
+    }
+    queue.entries[tail & BUFFER_RING_MASK] = entry;
+    queue.tail.store(tail + 1);
+    return true;
+}
+
+bool BufferQueue::PopControlEntry(BufferControlQueue& queue, BufferControlEntry& entry)
+{
+    uint32_t head = queue.head.load(std::memory_order_relaxed);
+    uint32_t size = queue.tail.load() - head;
+    /* The queue is in memory shared with another process, a corrupted one is treated as empty. */
+    if (size == 0 || size > BUFFER_QUEUE_SLOT_COUNT) {
+        return false;
+    }
+    entry = queue.entries[head & BUFFER_RING_MASK];
+    queue.head.store(head + 1);
+    return true;
+}
+
+uint32_t BufferQueue::GetControlQueueSize(const BufferControlQueue& queue)
+{
+    return queue.tail.load() - queue.head.load();
+}
+
+bool BufferQueue::IsStale(uint8_t slot) const
+{
+    return slots_[slot].attachSeq != resetSeq_.load();
+}
+
+uint8_t BufferQueue::NeedAttach()
+{
+    if (queueSize_ == attachCount_) {
+        GRAPHIC_LOGI("has alloced %u buffer, could not alloc more.", usedSlotCount_);
+        return BUFFER_SLOT_INVALID;
+    }
+    if (usedSlotCount_ == BUFFER_QUEUE_SLOT_COUNT) {
+        GRAPHIC_LOGI("No free slot, wait deletePending buffers released.");
+        return BUFFER_SLOT_INVALID;
+    }
     if (size_ == 0 && isValidAttr(width_, height_, format_, strideAlignment_) != SURFACE_ERROR_OK) {
         GRAPHIC_LOGI("Invalid Attr.");
-        return;
+        return BUFFER_SLOT_INVALID;
     }
     BufferManager* bufferManager = BufferManager::GetInstance();
-    RETURN_IF_FAIL(bufferManager);
+    RETURN_VAL_IF_FAIL(bufferManager, BUFFER_SLOT_INVALID);
     SurfaceBufferImpl *buffer = nullptr;
     if (size_ != 0 && customSize_) {
         buffer = bufferManager->AllocBuffer(size_, usage_);
@@ -96,105 +366,264 @@ void BufferQueue::NeedAttach()
     }
     if (buffer == nullptr) {
         GRAPHIC_LOGI("BufferManager alloc memory failed ");
-        return;
+        return BUFFER_SLOT_INVALID;
+    }
+    CountStat(stats_.allocs);
+    uint32_t stride = static_cast<uint32_t>(buffer->GetStride());
+    if (size_ != buffer->GetSize() || stride_ != stride) {
+        size_ = buffer->GetSize();
+        stride_ = stride;
+        attrSeq_++;
     }
-    size_ = buffer->GetSize();
-    stride_ = buffer->GetStride();
     attachCount_++;
-    freeList_.push_back(buffer);
-    allBuffers_.push_back(buffer);
+    uint8_t slot = AllocSlot(buffer);
+    slots_[slot].attachSeq = resetSeq_.load();
+    return slot;
 }
 
-bool BufferQueue::CanRequest(uint8_t wait)
+bool BufferQueue::CanRequest(uint8_t wait, const struct timespec* deadline)
 {
-    bool res = true;
-    if (!freeList_.empty()) {
-        res = true;
-        goto ERROR;
-    }
-    if (attachCount_ < queueSize_) {
-        NeedAttach();
-        res = true;
-        if (freeList_.empty()) {
-            GRAPHIC_LOGI("no buffer in freeQueue for dequeue.");
-            res = false;
+    while (freeList_.count == 0) {
+        /* When deletePending buffers hold all slots, wait for one of them to be released and detached. */
+        if (attachCount_ < queueSize_ && usedSlotCount_ < BUFFER_QUEUE_SLOT_COUNT) {
+            uint8_t slot = NeedAttach();
+            if (slot == BUFFER_SLOT_INVALID) {
+                GRAPHIC_LOGI("no buffer in freeQueue for dequeue.");
+                return false;
+            }
+            PushSlot(freeList_, slot);
+            return true;
+        }
+        if (controlRing_ != nullptr && GetControlQueueSize(controlRing_->freeQueue) != 0) {
+            /* The producer takes the free buffers waiting in the control ring instead. */
+            return false;
+        }
+        if (!wait) {
+            return false;
+        }
+        requestWaiters_++;
+        bool woken = WaitFreeBuffer(deadline);
+        requestWaiters_--;
+        if (!woken) {
+            return false;
         }
-        goto ERROR;
     }
-    if (wait) {
-        pthread_cond_wait(&freeCond_, &lock_);
-        res = true;
+    return true;
+}
+
+SurfaceBufferImpl* BufferQueue::RequestBufferLockFree(uint8_t wait, const struct timespec* deadline)
+{
+    uint64_t startUs = 0;
+    while (true) {
+        uint8_t slot = PopSlot(cancelList_);
+        if (slot == BUFFER_SLOT_INVALID) {
+            slot = PopRing(freeRing_);
+        }
+        if (slot != BUFFER_SLOT_INVALID && !IsStale(slot)) {
+            RecordRequest(startUs, true);
+            SetSlotState(slot, BUFFER_STATE_REQUEST);
+            return slots_[slot].buffer;
+        }
+        if (startUs == 0) {
+            startUs = GetMonotonicUs();
+        }
+        Lock();
+        if (slot != BUFFER_SLOT_INVALID) {
+            GRAPHIC_LOGI("Detach the buffer which is attached before reset.");
+            DetachDeletePending(slots_[slot].buffer);
+            pthread_mutex_unlock(&lock_);
+            continue;
+        }
+        /* Buffers preallocated in lock free mode are kept in free list, consumer only pushes free ring. */
+        slot = PopSlot(freeList_);
+        if (slot == BUFFER_SLOT_INVALID && attachCount_ < queueSize_ && usedSlotCount_ < BUFFER_QUEUE_SLOT_COUNT) {
+            slot = NeedAttach();
+            if (slot == BUFFER_SLOT_INVALID) {
+                pthread_mutex_unlock(&lock_);
+                RecordRequest(startUs, false);
+                GRAPHIC_LOGI("No buffer can request now.");
+                return nullptr;
+            }
+        }
+        if (slot != BUFFER_SLOT_INVALID) {
+            pthread_mutex_unlock(&lock_);
+            RecordRequest(startUs, true);
+            SetSlotState(slot, BUFFER_STATE_REQUEST);
+            return slots_[slot].buffer;
+        }
+        if (!wait) {
+            pthread_mutex_unlock(&lock_);
+            RecordRequest(startUs, false);
+            GRAPHIC_LOGI("No buffer can request now.");
+            return nullptr;
+        }
+        /* Release checks freeWaiters_ after pushing, so either it signals or the ring is not empty here. */
+        freeWaiters_++;
+        bool woken = true;
+        if (freeRing_.head.load() == freeRing_.tail.load()) {
+            woken = WaitFreeBuffer(deadline);
+        }
+        freeWaiters_--;
+        pthread_mutex_unlock(&lock_);
+        if (!woken) {
+            RecordRequest(startUs, false);
+            GRAPHIC_LOGI("Request buffer timed out.");
+            return nullptr;
+        }
     }
-ERROR:
-    return res;
 }
 
 SurfaceBufferImpl* BufferQueue::RequestBuffer(uint8_t wait)
 {
+    return RequestBuffer(wait, -1);
+}
+
+SurfaceBufferImpl* BufferQueue::RequestBuffer(uint8_t wait, int64_t timeout)
+{
+    struct timespec deadline;
+    struct timespec* pDeadline = nullptr;
+    if (wait && timeout >= 0) {
+        GetDeadline(timeout, deadline);
+        pDeadline = &deadline;
+    }
+    if (lockFree_) {
+        return RequestBufferLockFree(wait, pDeadline);
+    }
     SurfaceBufferImpl *buffer = nullptr;
-    pthread_mutex_lock(&lock_);
-    if (!CanRequest(wait)) {
+    uint8_t slot = BUFFER_SLOT_INVALID;
+    uint64_t startUs = 0;
+    Lock();
+    /* Read the clock only if the request has to attach or wait for a buffer. */
+    if (freeList_.count == 0) {
+        startUs = GetMonotonicUs();
+    }
+    if (!CanRequest(wait, pDeadline)) {
         GRAPHIC_LOGI("No buffer can request now.");
         goto ERROR;
     }
-    buffer = freeList_.front();
-    if (buffer == nullptr) {
+    slot = PopSlot(freeList_);
+    if (slot == BUFFER_SLOT_INVALID) {
         GRAPHIC_LOGI("freeQueue pop buffer failed.");
         goto ERROR;
     }
-    freeList_.pop_front();
-    buffer->SetState(BUFFER_STATE_REQUEST);
+    buffer = slots_[slot].buffer;
+    SetSlotState(slot, BUFFER_STATE_REQUEST);
 ERROR:
+    RecordRequest(startUs, buffer != nullptr);
     pthread_mutex_unlock(&lock_);
     return buffer;
 }
 
 SurfaceBufferImpl* BufferQueue::GetBuffer(const SurfaceBufferImpl& buffer)
 {
-    std::list<SurfaceBufferImpl *>::iterator iterBuffer;
-    for (iterBuffer = allBuffers_.begin(); iterBuffer != allBuffers_.end(); ++iterBuffer) {
-        SurfaceBufferImpl *tmpBuffer = *iterBuffer;
-        if (tmpBuffer->equals(buffer)) {
-            return tmpBuffer;
+    uint8_t slot = buffer.GetSlot();
+    if (slot >= BUFFER_QUEUE_SLOT_COUNT) {
+        return nullptr;
+    }
+    SurfaceBufferImpl *tmpBuffer = slots_[slot].buffer;
+    if (tmpBuffer == nullptr || slots_[slot].generation != buffer.GetGeneration() || !tmpBuffer->equals(buffer)) {
+        return nullptr;
+    }
+    return tmpBuffer;
+}
+
+int32_t BufferQueue::FlushBufferLockFree(SurfaceBufferImpl& buffer, SurfaceBufferImpl& tmpBuffer)
+{
+    if (&buffer != &tmpBuffer) {
+        tmpBuffer.MoveExtraData(buffer);
+    }
+    SetSlotState(tmpBuffer.GetSlot(), BUFFER_STATE_FLUSH);
+    PushRing(dirtyRing_, tmpBuffer.GetSlot());
+    CountStat(stats_.flushes);
+    return 0;
+}
+
+bool BufferQueue::QueueDirtySlot(uint8_t slot)
+{
+    bool dropped = false;
+    if (mailbox_) {
+        uint8_t dirtySlot;
+        while ((dirtySlot = PopSlot(dirtyList_)) != BUFFER_SLOT_INVALID) {
+            GRAPHIC_LOGD("Drop the dirty buffer which is not acquired in mailbox mode.");
+            /* Consumer never sees the dropped frame, so the queued frame carries its damage too. */
+            slots_[slot].buffer->MergeDamage(*slots_[dirtySlot].buffer);
+            RecycleBuffer(slots_[dirtySlot].buffer);
+            dropped = true;
         }
     }
-    return nullptr;
+    PushSlot(dirtyList_, slot);
+    SetSlotState(slot, BUFFER_STATE_FLUSH);
+    CountStat(stats_.flushes);
+    return dropped;
 }
 
 int32_t BufferQueue::FlushBuffer(SurfaceBufferImpl& buffer)
 {
-    pthread_mutex_lock(&lock_);
+    if (lockFree_) {
+        SurfaceBufferImpl *tmpBuffer = GetBuffer(buffer);
+        if (tmpBuffer == nullptr || tmpBuffer->GetState() != BUFFER_STATE_REQUEST) {
+            GRAPHIC_LOGI("Buffer is not existed or state invailed.");
+            return SURFACE_ERROR_BUFFER_NOT_EXISTED;
+        }
+        return FlushBufferLockFree(buffer, *tmpBuffer);
+    }
+    Lock();
     SurfaceBufferImpl *tmpBuffer = GetBuffer(buffer);
     if (tmpBuffer == nullptr || tmpBuffer->GetState() != BUFFER_STATE_REQUEST) {
         GRAPHIC_LOGI("Buffer is not existed or state invailed.");
         pthread_mutex_unlock(&lock_);
         return SURFACE_ERROR_BUFFER_NOT_EXISTED;
     }
-    dirtyList_.push_back(tmpBuffer);
     if (&buffer != tmpBuffer) {
-        tmpBuffer->CopyExtraData(buffer);
+        tmpBuffer->MoveExtraData(buffer);
     }
-    tmpBuffer->SetState(BUFFER_STATE_FLUSH);
+    bool dropped = QueueDirtySlot(FindSlot(tmpBuffer));
     pthread_mutex_unlock(&lock_);
+    if (dropped) {
+        pthread_cond_signal(&freeCond_);
+    }
     return 0;
 }
 
-SurfaceBufferImpl* BufferQueue::AcquireBuffer()
+SurfaceBufferImpl* BufferQueue::AcquireBufferLockFree()
 {
-    pthread_mutex_lock(&lock_);
-    if (dirtyList_.empty()) {
-        pthread_mutex_unlock(&lock_);
+    CountStat(stats_.acquires);
+    uint8_t slot = PopRing(dirtyRing_);
+    if (slot == BUFFER_SLOT_INVALID) {
+        CountStat(stats_.emptyAcquires);
         GRAPHIC_LOGD("dirty queue is empty.");
         return nullptr;
     }
-    SurfaceBufferImpl *buffer = dirtyList_.front();
-    if (buffer == nullptr) {
+    if (mailbox_) {
+        /* Producer could not take buffers back from dirty ring, so drop the older ones on consumer side. */
+        uint8_t next;
+        while ((next = PopRing(dirtyRing_)) != BUFFER_SLOT_INVALID) {
+            GRAPHIC_LOGD("Drop the dirty buffer which is not acquired in mailbox mode.");
+            slots_[next].buffer->MergeDamage(*slots_[slot].buffer);
+            ReleaseBufferLockFree(*slots_[slot].buffer, BUFFER_STATE_ACQUIRE);
+            slot = next;
+        }
+    }
+    SetSlotState(slot, BUFFER_STATE_ACQUIRE);
+    return slots_[slot].buffer;
+}
+
+SurfaceBufferImpl* BufferQueue::AcquireBuffer()
+{
+    if (lockFree_) {
+        return AcquireBufferLockFree();
+    }
+    CountStat(stats_.acquires);
+    Lock();
+    uint8_t slot = PopSlot(dirtyList_);
+    if (slot == BUFFER_SLOT_INVALID) {
+        CountStat(stats_.emptyAcquires);
         pthread_mutex_unlock(&lock_);
-        GRAPHIC_LOGW("dirty queue pop buffer failed.");
+        GRAPHIC_LOGD("dirty queue is empty.");
         return nullptr;
     }
-    buffer->SetState(BUFFER_STATE_ACQUIRE);
-    dirtyList_.pop_front();
+    SurfaceBufferImpl *buffer = slots_[slot].buffer;
+    SetSlotState(slot, BUFFER_STATE_ACQUIRE);
     pthread_mutex_unlock(&lock_);
     return buffer;
 }
@@ -205,15 +634,23 @@ void BufferQueue::Detach(SurfaceBufferImpl *buffer)
         GRAPHIC_LOGW("Detach buffer failed, buffer is null.");
         return;
     }
-    freeList_.remove(buffer);
-    dirtyList_.remove(buffer);
-    allBuffers_.remove(buffer);
+    uint8_t slot = FindSlot(buffer);
+    if (slot != BUFFER_SLOT_INVALID) {
+        FreeSlot(slot);
+    }
     BufferManager* bufferManager = BufferManager::GetInstance();
     if (bufferManager != nullptr) {
         bufferManager->FreeBuffer(&buffer);
+        CountStat(stats_.frees);
     }
 }
 
+void BufferQueue::DetachDeletePending(SurfaceBufferImpl* buffer)
+{
+    CountStat(stats_.deletePendingDetaches);
+    Detach(buffer);
+}
+
 bool BufferQueue::ReleaseBuffer(const SurfaceBufferImpl& buffer)
 {
     return ReleaseBuffer(buffer, BUFFER_STATE_ACQUIRE) == SURFACE_ERROR_OK;
@@ -224,10 +661,65 @@ int32_t BufferQueue::CancelBuffer(const SurfaceBufferImpl& buffer)
     return ReleaseBuffer(buffer, BUFFER_STATE_REQUEST);
 }
 
+void BufferQueue::RecycleBuffer(SurfaceBufferImpl* buffer)
+{
+    if (buffer->GetDeletePending() == 1) {
+        GRAPHIC_LOGI("Release the buffer which state is deletePending.");
+        DetachDeletePending(buffer);
+        return;
+    }
+
+    if (usedSlotCount_ > queueSize_) {
+        GRAPHIC_LOGI("Release the buffer: alloc buffer count is more than max queue count.");
+        attachCount_--;
+        Detach(buffer);
+        return;
+    }
+
+    uint8_t slot = FindSlot(buffer);
+    PushSlot(freeList_, slot);
+    SetSlotState(slot, BUFFER_STATE_RELEASE);
+    buffer->ClearExtraData();
+}
+
+int32_t BufferQueue::ReleaseBufferLockFree(SurfaceBufferImpl& tmpBuffer, BufferState state)
+{
+    uint8_t slot = tmpBuffer.GetSlot();
+    SetSlotState(slot, BUFFER_STATE_RELEASE);
+    tmpBuffer.ClearExtraData();
+    if (state == BUFFER_STATE_REQUEST) {
+        /* Canceled by producer, which is the only one pops free buffers, keep it aside for next request. */
+        PushSlot(cancelList_, slot);
+        return SURFACE_ERROR_OK;
+    }
+    if (IsStale(slot)) {
+        GRAPHIC_LOGI("Release the buffer which state is deletePending.");
+        Lock();
+        DetachDeletePending(&tmpBuffer);
+    } else {
+        PushRing(freeRing_, slot);
+        if (freeWaiters_.load() == 0) {
+            return SURFACE_ERROR_OK;
+        }
+        Lock();
+    }
+    pthread_mutex_unlock(&lock_);
+    pthread_cond_signal(&freeCond_);
+    return SURFACE_ERROR_OK;
+}
+
 int32_t BufferQueue::ReleaseBuffer(const SurfaceBufferImpl& buffer, BufferState state)
 {
     int32_t ret = 0;
-    pthread_mutex_lock(&lock_);
+    if (lockFree_) {
+        SurfaceBufferImpl *tmpBuffer = GetBuffer(buffer);
+        if (tmpBuffer == nullptr || tmpBuffer->GetState() != state) {
+            GRAPHIC_LOGI("Buffer is not existed or state invailed.");
+            return SURFACE_ERROR_BUFFER_NOT_EXISTED;
+        }
+        return ReleaseBufferLockFree(*tmpBuffer, state);
+    }
+    Lock();
     SurfaceBufferImpl *tmpBuffer = GetBuffer(buffer);
     if (tmpBuffer == nullptr || tmpBuffer->GetState() != state) {
         GRAPHIC_LOGI("Buffer is not existed or state invailed.");
@@ -235,24 +727,10 @@ int32_t BufferQueue::ReleaseBuffer(const SurfaceBufferImpl& buffer, BufferState
         goto ERROR;
     }
 
-    if (tmpBuffer->GetDeletePending() == 1) {
-        GRAPHIC_LOGI("Release the buffer which state is deletePending.");
-        Detach(tmpBuffer);
-        ret = SURFACE_ERROR_OK;
-        goto ERROR;
-    }
-
-    if (allBuffers_.size() > queueSize_) {
-        GRAPHIC_LOGI("Release the buffer: alloc buffer count is more than max queue count.");
-        attachCount_--;
-        Detach(tmpBuffer);
-        ret = SURFACE_ERROR_OK;
-        goto ERROR;
+    RecycleBuffer(tmpBuffer);
+    if (state == BUFFER_STATE_ACQUIRE) {
+        RefillControlRing();
     }
-
-    freeList_.push_back(tmpBuffer);
-    tmpBuffer->SetState(BUFFER_STATE_RELEASE);
-    tmpBuffer->ClearExtraData();
 ERROR:
     pthread_mutex_unlock(&lock_);
     pthread_cond_signal(&freeCond_);
@@ -279,22 +757,20 @@ int32_t BufferQueue::Reset(uint32_t size)
             customSize_ = false;
         }
     }
-    std::list<SurfaceBufferImpl *>::iterator iterBuffer = freeList_.begin();
-    while (iterBuffer != freeList_.end()) {
-        SurfaceBufferImpl *tmpBuffer = *iterBuffer;
-        dirtyList_.remove(tmpBuffer);
-        allBuffers_.remove(tmpBuffer);
-        BufferManager* bufferManager = BufferManager::GetInstance();
-        if (bufferManager == nullptr) {
-             ++iterBuffer;
-            continue;
-        }
-        bufferManager->FreeBuffer(&tmpBuffer);
-        iterBuffer = freeList_.erase(iterBuffer);
+    BufferManager* bufferManager = BufferManager::GetInstance();
+    RETURN_VAL_IF_FAIL(bufferManager, SURFACE_ERROR_NOT_READY);
+    while (freeList_.count != 0) {
+        Detach(slots_[PopSlot(freeList_)].buffer);
+    }
+    /* In lock free mode free buffers stay in the ring, and are detached when they come out of it. */
+    resetSeq_++;
+    if (controlRing_ != nullptr) {
+        controlRing_->resetSeq.store(resetSeq_.load());
     }
-    for (iterBuffer = allBuffers_.begin(); iterBuffer != allBuffers_.end(); ++iterBuffer) {
-        SurfaceBufferImpl *tmpBuffer = *iterBuffer;
-        tmpBuffer->SetDeletePending(1);
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        if (slots_[i].buffer != nullptr) {
+            slots_[i].buffer->SetDeletePending(1);
+        }
     }
     attachCount_ = 0;
     return 0;
@@ -306,26 +782,20 @@ void BufferQueue::SetQueueSize(uint8_t queueSize)
         GRAPHIC_LOGI("The queue count(%u) is invalid", queueSize);
         return;
     }
-    pthread_mutex_lock(&lock_);
-    if (queueSize_ > queueSize) {
+    Lock();
+    attrSeq_++;
+    if (queueSize_ > queueSize && lockFree_) {
+        /* Free buffers could not be taken out of the ring here, so re-attach buffers like a reset. */
+        queueSize_ = queueSize;
+        Reset(size_);
+        pthread_mutex_unlock(&lock_);
+    } else if (queueSize_ > queueSize) {
         uint8_t needDelete = queueSize_ - queueSize;
-        std::list<SurfaceBufferImpl *>::iterator iterBuffer = freeList_.begin();
-        while (iterBuffer != freeList_.end()) {
-            SurfaceBufferImpl *tmpBuffer = *iterBuffer;
-            dirtyList_.remove(tmpBuffer);
-            allBuffers_.remove(tmpBuffer);
-            BufferManager* bufferManager = BufferManager::GetInstance();
-            if (bufferManager == nullptr) {
-                ++iterBuffer;
-                continue;
-            }
-            bufferManager->FreeBuffer(&tmpBuffer);
-            iterBuffer = freeList_.erase(iterBuffer);
+        BufferManager* bufferManager = BufferManager::GetInstance();
+        while (bufferManager != nullptr && needDelete > 0 && freeList_.count != 0) {
+            Detach(slots_[PopSlot(freeList_)].buffer);
             needDelete--;
             attachCount_--;
-            if (needDelete == 0) {
-                break;
-            }
         }
         queueSize_ = queueSize;
         pthread_mutex_unlock(&lock_);
@@ -336,6 +806,109 @@ void BufferQueue::SetQueueSize(uint8_t queueSize)
     }
 }
 
+void BufferQueue::SetLockFreeMode(bool enable)
+{
+    Lock();
+    if (enable && controlRing_ != nullptr) {
+        GRAPHIC_LOGW("Lock free mode is not available with control ring.");
+        pthread_mutex_unlock(&lock_);
+        return;
+    }
+    if (lockFree_ == enable) {
+        pthread_mutex_unlock(&lock_);
+        return;
+    }
+    uint8_t slot;
+    if (enable) {
+        uint32_t resetSeq = resetSeq_.load();
+        for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+            if (slots_[i].buffer != nullptr) {
+                slots_[i].attachSeq = (slots_[i].buffer->GetDeletePending() == 1) ? (resetSeq - 1) : resetSeq;
+            }
+        }
+        while ((slot = PopSlot(freeList_)) != BUFFER_SLOT_INVALID) {
+            PushRing(freeRing_, slot);
+        }
+        while ((slot = PopSlot(dirtyList_)) != BUFFER_SLOT_INVALID) {
+            PushRing(dirtyRing_, slot);
+        }
+    } else {
+        while ((slot = PopSlot(cancelList_)) != BUFFER_SLOT_INVALID ||
+            (slot = PopRing(freeRing_)) != BUFFER_SLOT_INVALID) {
+            if (IsStale(slot)) {
+                DetachDeletePending(slots_[slot].buffer);
+            } else {
+                PushSlot(freeList_, slot);
+            }
+        }
+        while ((slot = PopRing(dirtyRing_)) != BUFFER_SLOT_INVALID) {
+            PushSlot(dirtyList_, slot);
+        }
+    }
+    lockFree_ = enable;
+    pthread_mutex_unlock(&lock_);
+    pthread_cond_signal(&freeCond_);
+}
+
+void BufferQueue::SetMailboxMode(bool enable)
+{
+    Lock();
+    mailbox_ = enable;
+    pthread_mutex_unlock(&lock_);
+}
+
+int32_t BufferQueue::AttachAllBuffers()
+{
+    int32_t ret = SURFACE_ERROR_OK;
+    Lock();
+    while (attachCount_ < queueSize_) {
+        uint8_t slot = NeedAttach();
+        if (slot == BUFFER_SLOT_INVALID) {
+            GRAPHIC_LOGW("Preallocate buffer failed.");
+            ret = SURFACE_ERROR_NOT_READY;
+            break;
+        }
+        PushSlot(freeList_, slot);
+    }
+    pthread_mutex_unlock(&lock_);
+    pthread_cond_signal(&freeCond_);
+    return ret;
+}
+
+void* BufferQueue::PreallocateThread(void* arg)
+{
+    BufferQueue* bufferQueue = static_cast<BufferQueue*>(arg);
+    bufferQueue->AttachAllBuffers();
+    return nullptr;
+}
+
+void BufferQueue::JoinPreallocateThread()
+{
+    if (preallocateStarted_) {
+        pthread_join(preallocateThread_, nullptr);
+        preallocateStarted_ = false;
+    }
+}
+
+int32_t BufferQueue::Preallocate(bool async)
+{
+    /* Local consumer and the ipc handler could preallocate at the same time, only one owns the thread. */
+    pthread_mutex_lock(&preallocateLock_);
+    JoinPreallocateThread();
+    if (!async) {
+        pthread_mutex_unlock(&preallocateLock_);
+        return AttachAllBuffers();
+    }
+    if (pthread_create(&preallocateThread_, nullptr, PreallocateThread, this) != 0) {
+        pthread_mutex_unlock(&preallocateLock_);
+        GRAPHIC_LOGE("Create preallocate thread failed.");
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    preallocateStarted_ = true;
+    pthread_mutex_unlock(&preallocateLock_);
+    return SURFACE_ERROR_OK;
+}
+
 uint8_t BufferQueue::GetQueueSize()
 {
     return queueSize_;
@@ -343,9 +916,10 @@ uint8_t BufferQueue::GetQueueSize()
 
 void BufferQueue::SetWidthAndHeight(uint32_t width, uint32_t height)
 {
-    pthread_mutex_lock(&lock_);
+    Lock();
     width_ = width;
     height_ = height;
+    attrSeq_++;
     Reset();
     pthread_mutex_unlock(&lock_);
     pthread_cond_signal(&freeCond_);
@@ -363,9 +937,10 @@ int32_t BufferQueue::GetHeight()
 
 void BufferQueue::SetSize(uint32_t size)
 {
-    pthread_mutex_lock(&lock_);
+    Lock();
     size_ = size;
     customSize_ = true;
+    attrSeq_++;
     Reset(size);
     pthread_mutex_unlock(&lock_);
     pthread_cond_signal(&freeCond_);
@@ -399,8 +974,9 @@ void BufferQueue::SetFormat(uint32_t format)
         GRAPHIC_LOGI("Format is invailed or not supported %u", format);
         return;
     }
-    pthread_mutex_lock(&lock_);
+    Lock();
     format_ = format;
+    attrSeq_++;
     Reset();
     pthread_mutex_unlock(&lock_);
     pthread_cond_signal(&freeCond_);
@@ -413,8 +989,9 @@ int32_t BufferQueue::GetFormat()
 
 void BufferQueue::SetStrideAlignment(uint32_t stride)
 {
-    pthread_mutex_lock(&lock_);
+    Lock();
     strideAlignment_ = stride;
+    attrSeq_++;
     Reset();
     pthread_mutex_unlock(&lock_);
     pthread_cond_signal(&freeCond_);
@@ -432,8 +1009,9 @@ int32_t BufferQueue::GetStride()
 
 void BufferQueue::SetUsage(uint32_t usage)
 {
-    pthread_mutex_lock(&lock_);
+    Lock();
     usage_ = usage;
+    attrSeq_++;
     Reset();
     pthread_mutex_unlock(&lock_);
     pthread_cond_signal(&freeCond_);
@@ -443,4 +1021,332 @@ int32_t BufferQueue::GetUsage()
 {
     return usage_;
 }
+
+int32_t BufferQueue::SetAttributes(const SurfaceAttributes& attributes)
+{
+    /* Attributes may come from ipc directly, check all of them before any is written. */
+    if (isValidAttr(attributes.width, attributes.height, attributes.format, attributes.strideAlignment) !=
+        SURFACE_ERROR_OK || attributes.width > SURFACE_MAX_WIDTH || attributes.height > SURFACE_MAX_HEIGHT ||
+        attributes.strideAlignment < SURFACE_MIN_STRIDE_ALIGNMENT ||
+        attributes.strideAlignment > SURFACE_MAX_STRIDE_ALIGNMENT || attributes.size >= SURFACE_MAX_SIZE ||
+        attributes.usage >= BUFFER_CONSUMER_USAGE_MAX || attributes.queueSize < SURFACE_MIN_QUEUE_SIZE ||
+        attributes.queueSize > BUFFER_QUEUE_SIZE_MAX) {
+        GRAPHIC_LOGI("Attributes are invailed, %ux%u format(%u) queue size(%u)", attributes.width,
+            attributes.height, attributes.format, attributes.queueSize);
+        return SURFACE_ERROR_INVALID_PARAM;
+    }
+    Lock();
+    bool customSize = (attributes.size != 0);
+    if (width_ == attributes.width && height_ == attributes.height && format_ == attributes.format &&
+        strideAlignment_ == attributes.strideAlignment && usage_ == attributes.usage &&
+        queueSize_ == attributes.queueSize && customSize_ == customSize && (!customSize || size_ == attributes.size)) {
+        pthread_mutex_unlock(&lock_);
+        return SURFACE_ERROR_OK;
+    }
+    width_ = attributes.width;
+    height_ = attributes.height;
+    format_ = attributes.format;
+    strideAlignment_ = attributes.strideAlignment;
+    usage_ = attributes.usage;
+    queueSize_ = attributes.queueSize;
+    attrSeq_++;
+    int32_t ret;
+    if (customSize) {
+        size_ = attributes.size;
+        customSize_ = true;
+        ret = Reset(attributes.size);
+    } else {
+        ret = Reset();
+    }
+    pthread_mutex_unlock(&lock_);
+    pthread_cond_signal(&freeCond_);
+    return ret;
+}
+
+void BufferQueue::GetAttributes(SurfaceAttributes& attributes)
+{
+    Lock();
+    attributes.width = width_;
+    attributes.height = height_;
+    attributes.format = format_;
+    attributes.strideAlignment = strideAlignment_;
+    attributes.usage = usage_;
+    attributes.size = customSize_ ? size_ : 0;
+    attributes.stride = stride_;
+    attributes.queueSize = queueSize_;
+    pthread_mutex_unlock(&lock_);
+}
+
+SurfaceBufferImpl* BufferQueue::EnableControlRing()
+{
+    Lock();
+    if (lockFree_) {
+        GRAPHIC_LOGW("Control ring is not available in lock free mode.");
+        pthread_mutex_unlock(&lock_);
+        return nullptr;
+    }
+    if (controlBuffer_ == nullptr) {
+        BufferManager* bufferManager = BufferManager::GetInstance();
+        SurfaceBufferImpl* buffer = nullptr;
+        if (bufferManager != nullptr) {
+            buffer = bufferManager->AllocBuffer(sizeof(BufferControlRing), BUFFER_CONSUMER_USAGE_SORTWARE);
+        }
+        if (buffer == nullptr || buffer->GetVirAddr() == nullptr) {
+            GRAPHIC_LOGW("Alloc control ring failed.");
+            if (buffer != nullptr) {
+                bufferManager->FreeBuffer(&buffer);
+            }
+            pthread_mutex_unlock(&lock_);
+            return nullptr;
+        }
+        controlRing_ = new (buffer->GetVirAddr()) BufferControlRing();
+        controlRing_->resetSeq = resetSeq_.load();
+        controlRing_->freeQueue.head = 0;
+        controlRing_->freeQueue.tail = 0;
+        controlRing_->dirtyQueue.head = 0;
+        controlRing_->dirtyQueue.tail = 0;
+        controlBuffer_ = buffer;
+        RefillControlRing();
+    }
+    SurfaceBufferImpl* buffer = controlBuffer_;
+    pthread_mutex_unlock(&lock_);
+    return buffer;
+}
+
+void BufferQueue::RefillControlRing()
+{
+    /* Requests blocked in buffer queue get free buffers first, they could not see the control ring. */
+    if (controlRing_ == nullptr || requestWaiters_ != 0) {
+        return;
+    }
+    while (GetControlQueueSize(controlRing_->freeQueue) < queueSize_) {
+        uint8_t slot = PopSlot(freeList_);
+        if (slot == BUFFER_SLOT_INVALID && attachCount_ < queueSize_) {
+            slot = NeedAttach();
+        }
+        if (slot == BUFFER_SLOT_INVALID) {
+            return;
+        }
+        BufferControlEntry entry = {slot, 0, slots_[slot].generation, resetSeq_.load()};
+        if (!PushControlEntry(controlRing_->freeQueue, entry)) {
+            PushSlot(freeList_, slot);
+            return;
+        }
+        SetSlotState(slot, BUFFER_STATE_REQUEST);
+    }
+}
+
+uint8_t BufferQueue::DrainControlRing()
+{
+    Lock();
+    if (controlRing_ == nullptr) {
+        pthread_mutex_unlock(&lock_);
+        return 0;
+    }
+    uint32_t size = GetControlQueueSize(controlRing_->dirtyQueue);
+    if (size > BUFFER_QUEUE_SLOT_COUNT) {
+        pthread_mutex_unlock(&lock_);
+        GRAPHIC_LOGW("Control ring is corrupted, size=%u", size);
+        return 0;
+    }
+    uint8_t flushed = 0;
+    bool recycled = false;
+    bool canceled = false;
+    BufferControlEntry entry;
+    /* Producer could keep pushing while draining, take at most one queue of entries under the lock. */
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT && PopControlEntry(controlRing_->dirtyQueue, entry); i++) {
+        uint8_t slot = entry.slot;
+        if (slot >= BUFFER_QUEUE_SLOT_COUNT || slots_[slot].buffer == nullptr ||
+            slots_[slot].generation != entry.generation ||
+            slots_[slot].buffer->GetState() != BUFFER_STATE_REQUEST) {
+            GRAPHIC_LOGI("Buffer is not existed or state invailed.");
+            continue;
+        }
+        if (entry.canceled) {
+            CountStat(stats_.requestSucceeded);
+            RecycleBuffer(slots_[slot].buffer);
+            recycled = true;
+            canceled = true;
+            continue;
+        }
+        CountStat(stats_.requestSucceeded);
+        recycled = QueueDirtySlot(slot) || recycled;
+        flushed++;
+    }
+    /* Canceled buffers are going to be requested by ipc, so that the producer could map them. */
+    if (!canceled) {
+        RefillControlRing();
+    }
+    pthread_mutex_unlock(&lock_);
+    if (recycled) {
+        pthread_cond_signal(&freeCond_);
+    }
+    return flushed;
+}
+
+uint32_t BufferQueue::GetAttrSequence() const
+{
+    return attrSeq_.load();
+}
+
+uint32_t BufferQueue::GetResetSequence() const
+{
+    return resetSeq_.load();
+}
+
+void BufferQueue::SetSlotState(uint8_t slot, BufferState state)
+{
+    BufferSlot& node = slots_[slot];
+    uint64_t now = GetMonotonicUs();
+    BufferState lastState = node.buffer->GetState();
+    /* Canceled buffers and buffers dropped in mailbox mode are not counted. */
+    if (state == BUFFER_STATE_FLUSH && lastState == BUFFER_STATE_REQUEST) {
+        RecordLatency(latency_.producerHold, now - node.stateTime);
+    } else if (state == BUFFER_STATE_ACQUIRE && lastState == BUFFER_STATE_FLUSH) {
+        RecordLatency(latency_.queueDwell, now - node.stateTime);
+    } else if (state == BUFFER_STATE_RELEASE && lastState == BUFFER_STATE_ACQUIRE) {
+        RecordLatency(latency_.consumerHold, now - node.stateTime);
+    }
+    node.stateTime = now;
+    node.buffer->SetState(state);
+}
+
+void BufferQueue::RecordRequest(uint64_t startUs, bool succeeded)
+{
+    CountStat(succeeded ? stats_.requestSucceeded : stats_.requestFailed);
+    RecordLatency(latency_.requestWait, (startUs == 0) ? 0 : (GetMonotonicUs() - startUs));
+}
+
+void BufferQueue::RecordLatency(BufferLatencyHistogram& histogram, uint64_t latencyUs)
+{
+    uint8_t bucket = 0;
+    for (uint64_t us = latencyUs; (us >> 1) != 0 && bucket < SURFACE_LATENCY_BUCKET_COUNT - 1; us >>= 1) {
+        bucket++;
+    }
+    /* Only one thread records a histogram, relaxed load and store are enough for readers. */
+    histogram.buckets[bucket].store(histogram.buckets[bucket].load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    histogram.count.store(histogram.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    histogram.totalUs.store(histogram.totalUs.load(std::memory_order_relaxed) + latencyUs,
+        std::memory_order_relaxed);
+    if (latencyUs > histogram.maxUs.load(std::memory_order_relaxed)) {
+        histogram.maxUs.store(latencyUs, std::memory_order_relaxed);
+    }
+}
+
+void BufferQueue::ReadLatency(const BufferLatencyHistogram& histogram, SurfaceLatencyHistogram& stats)
+{
+    stats.count = histogram.count.load(std::memory_order_relaxed);
+    for (uint8_t i = 0; i < SURFACE_LATENCY_BUCKET_COUNT; i++) {
+        stats.buckets[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+    }
+    stats.totalUs = histogram.totalUs.load(std::memory_order_relaxed);
+    stats.maxUs = histogram.maxUs.load(std::memory_order_relaxed);
+}
+
+void BufferQueue::GetLatencyStats(SurfaceLatencyStats& stats) const
+{
+    ReadLatency(latency_.producerHold, stats.producerHold);
+    ReadLatency(latency_.queueDwell, stats.queueDwell);
+    ReadLatency(latency_.consumerHold, stats.consumerHold);
+    ReadLatency(latency_.requestWait, stats.requestWait);
+}
+
+void BufferQueue::GetStats(SurfaceStats& stats) const
+{
+    stats.waitUs = stats_.waitUs.load(std::memory_order_relaxed);
+    stats.requestSucceeded = stats_.requestSucceeded.load(std::memory_order_relaxed);
+    stats.requestFailed = stats_.requestFailed.load(std::memory_order_relaxed);
+    stats.requests = stats.requestSucceeded + stats.requestFailed;
+    stats.waits = stats_.waits.load(std::memory_order_relaxed);
+    stats.flushes = stats_.flushes.load(std::memory_order_relaxed);
+    stats.acquires = stats_.acquires.load(std::memory_order_relaxed);
+    stats.emptyAcquires = stats_.emptyAcquires.load(std::memory_order_relaxed);
+    stats.allocs = stats_.allocs.load(std::memory_order_relaxed);
+    stats.frees = stats_.frees.load(std::memory_order_relaxed);
+    stats.deletePendingDetaches = stats_.deletePendingDetaches.load(std::memory_order_relaxed);
+    stats.peakFreeDepth = stats_.peakFreeDepth.load(std::memory_order_relaxed);
+    stats.peakDirtyDepth = stats_.peakDirtyDepth.load(std::memory_order_relaxed);
+    stats.lockContentions = stats_.lockContentions.load(std::memory_order_relaxed);
+    stats.lockWaitUs = stats_.lockWaitUs.load(std::memory_order_relaxed);
+}
+
+bool BufferQueue::CheckSlotList(const BufferSlotList& list, BufferState expectState, uint8_t& listedCount) const
+{
+    uint8_t count = 0;
+    uint8_t prev = BUFFER_SLOT_INVALID;
+    for (uint8_t slot = list.head; slot != BUFFER_SLOT_INVALID; slot = slots_[slot].next) {
+        if (slot >= BUFFER_QUEUE_SLOT_COUNT || count >= BUFFER_QUEUE_SLOT_COUNT) {
+            GRAPHIC_LOGE("Slot list is broken at slot(%u)", slot);
+            return false;
+        }
+        const BufferSlot& node = slots_[slot];
+        if (node.buffer == nullptr || node.owner != &list || node.prev != prev) {
+            GRAPHIC_LOGE("Slot(%u) is not well linked in its list", slot);
+            return false;
+        }
+        BufferState state = node.buffer->GetState();
+        /* A new attached buffer has no state yet. */
+        if (state != expectState && !(expectState == BUFFER_STATE_RELEASE && state == BUFFER_STATE_NONE)) {
+            GRAPHIC_LOGE("Slot(%u) is listed in state(%d)", slot, state);
+            return false;
+        }
+        prev = slot;
+        count++;
+    }
+    if (list.tail != prev || list.count != count) {
+        GRAPHIC_LOGE("Slot list count(%u) does not match its %u slots", list.count, count);
+        return false;
+    }
+    listedCount += count;
+    return true;
+}
+
+int32_t BufferQueue::CheckInvariants()
+{
+    int32_t ret = SURFACE_ERROR_SYSTEM_ERROR;
+    uint8_t usedCount = 0;
+    uint8_t attachedCount = 0;
+    uint8_t ownedCount = 0;
+    uint8_t listedCount = 0;
+    Lock();
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        if (slots_[i].buffer == nullptr) {
+            if (slots_[i].owner != nullptr) {
+                GRAPHIC_LOGE("Empty slot(%u) is listed", i);
+                goto ERROR;
+            }
+            continue;
+        }
+        if (slots_[i].buffer->GetSlot() != i || slots_[i].buffer->GetGeneration() != slots_[i].generation) {
+            GRAPHIC_LOGE("Buffer of slot(%u) does not point back to the slot", i);
+            goto ERROR;
+        }
+        usedCount++;
+        if (!IsStale(i)) {
+            attachedCount++;
+        }
+        if (slots_[i].owner != nullptr) {
+            ownedCount++;
+        }
+    }
+    if (usedCount != usedSlotCount_ || attachedCount != attachCount_) {
+        GRAPHIC_LOGE("Used slots(%u) or attached buffers(%u) do not match the counts(%u, %u)",
+            usedCount, attachedCount, usedSlotCount_, attachCount_);
+        goto ERROR;
+    }
+    if (!CheckSlotList(freeList_, BUFFER_STATE_RELEASE, listedCount) ||
+        !CheckSlotList(dirtyList_, BUFFER_STATE_FLUSH, listedCount) ||
+        !CheckSlotList(cancelList_, BUFFER_STATE_RELEASE, listedCount)) {
+        goto ERROR;
+    }
+    if (listedCount != ownedCount) {
+        GRAPHIC_LOGE("Listed slots(%u) do not match the slots owned by lists(%u)", listedCount, ownedCount);
+        goto ERROR;
+    }
+    ret = SURFACE_ERROR_OK;
+ERROR:
+    pthread_mutex_unlock(&lock_);
+    return ret;
+}
 } // end namespace
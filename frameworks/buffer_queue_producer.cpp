@@ -22,18 +22,18 @@
 
 namespace OHOS {
 const int32_t DEFAULT_IPC_SIZE = 100;
+const int32_t REQUEST_REPLY_IPC_SIZE = 200;
 
 extern "C" {
 typedef int32_t (*IpcMsgHandle)(BufferQueueProducer* product, void *ipcMsg, IpcIo *io);
 };
 
-static int32_t OnRequestBuffer(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+static int32_t SendRequestBufferReply(BufferQueueProducer* product, SurfaceBufferImpl* buffer,
+    uint32_t clientSequence, void *ipcMsg)
 {
-    uint8_t isWaiting = IpcIoPopUint8(io);
-    SurfaceBufferImpl* buffer = product->RequestBuffer(isWaiting);
     IpcIo reply;
-    uint8_t tmpData[DEFAULT_IPC_SIZE];
-    IpcIoInit(&reply, tmpData, DEFAULT_IPC_SIZE, 1);
+    uint8_t tmpData[REQUEST_REPLY_IPC_SIZE];
+    IpcIoInit(&reply, tmpData, REQUEST_REPLY_IPC_SIZE, 1);
     uint32_t ret = -1;
     if (buffer == nullptr) {
         GRAPHIC_LOGW("get buffer failed");
@@ -44,10 +44,33 @@ static int32_t OnRequestBuffer(BufferQueueProducer* product, void *ipcMsg, IpcIo
         buffer->WriteToIpcIo(reply);
         ret = 0;
     }
+    /* Piggyback the attributes only when the client cache is stale. */
+    BufferAttrSnapshot snapshot = {{0}, 0, 0, 0};
+    product->GetAttrSnapshot(snapshot);
+    IpcIoPushUint32(&reply, snapshot.sequence);
+    if (snapshot.sequence != clientSequence) {
+        IpcIoPushFlatObj(&reply, &snapshot, sizeof(BufferAttrSnapshot));
+    }
+    IpcIoPushInt32(&reply, product->TakeAsyncFlushError());
     SendReply(nullptr, ipcMsg, &reply);
     return ret;
 }
 
+static int32_t OnRequestBuffer(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    uint8_t isWaiting = IpcIoPopUint8(io);
+    uint32_t sequence = IpcIoPopUint32(io);
+    return SendRequestBufferReply(product, product->RequestBuffer(isWaiting), sequence, ipcMsg);
+}
+
+static int32_t OnRequestBufferTimeout(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    uint8_t isWaiting = IpcIoPopUint8(io);
+    int64_t timeout = IpcIoPopInt64(io);
+    uint32_t sequence = IpcIoPopUint32(io);
+    return SendRequestBufferReply(product, product->RequestBuffer(isWaiting, timeout), sequence, ipcMsg);
+}
+
 static int32_t OnFlushBuffer(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
 {
     IpcIo reply;
@@ -60,6 +83,19 @@ static int32_t OnFlushBuffer(BufferQueueProducer* product, void *ipcMsg, IpcIo *
     return 0;
 }
 
+static int32_t OnFlushBufferAsync(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    SurfaceBufferImpl buffer;
+    buffer.ReadFromIpcIo(*io);
+    int32_t ret = product->EnqueueBuffer(buffer);
+    if (ret != SURFACE_ERROR_OK) {
+        GRAPHIC_LOGW("Async flush buffer failed, ret=%d", ret);
+        product->SetAsyncFlushError(ret);
+    }
+    FreeBuffer(nullptr, ipcMsg);
+    return 0;
+}
+
 static int32_t OnCancelBuffer(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
 {
     SurfaceBufferImpl buffer;
@@ -106,6 +142,17 @@ static int32_t OnGetQueueSize(BufferQueueProducer* product, void *ipcMsg, IpcIo
     return OnGetAttr(product->GetQueueSize(), ipcMsg, io);
 }
 
+static int32_t OnPreallocate(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    bool async = IpcIoPopBool(io);
+    IpcIo reply;
+    uint8_t tmpData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&reply, tmpData, DEFAULT_IPC_SIZE, 1);
+    IpcIoPushInt32(&reply, product->Preallocate(async));
+    SendReply(nullptr, ipcMsg, &reply);
+    return 0;
+}
+
 static int32_t OnSetWidthAndHeight(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
 {
     uint32_t width = IpcIoPopUint32(io);
@@ -177,6 +224,75 @@ static int32_t OnGetUsage(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
     return OnGetAttr(product->GetUsage(), ipcMsg, io);
 }
 
+static int32_t OnSetAttributes(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    uint32_t size = 0;
+    void* attributes = IpcIoPopFlatObj(io, &size);
+    int32_t ret = SURFACE_ERROR_INVALID_PARAM;
+    if (attributes != nullptr && size == sizeof(SurfaceAttributes)) {
+        ret = product->SetAttributes(*static_cast<SurfaceAttributes*>(attributes));
+    }
+    IpcIo reply;
+    uint8_t tmpData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&reply, tmpData, DEFAULT_IPC_SIZE, 1);
+    IpcIoPushInt32(&reply, ret);
+    SendReply(nullptr, ipcMsg, &reply);
+    return 0;
+}
+
+static int32_t OnGetAttributes(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    BufferAttrSnapshot snapshot = {{0}, 0, 0, 0};
+    product->GetAttrSnapshot(snapshot);
+    IpcIo reply;
+    uint8_t tmpData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&reply, tmpData, DEFAULT_IPC_SIZE, 1);
+    IpcIoPushInt32(&reply, 0);
+    IpcIoPushFlatObj(&reply, &snapshot, sizeof(BufferAttrSnapshot));
+    SendReply(nullptr, ipcMsg, &reply);
+    return 0;
+}
+
+static int32_t OnGetStats(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    SurfaceStats stats = {0};
+    int32_t ret = product->GetStats(stats);
+    IpcIo reply;
+    uint8_t tmpData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&reply, tmpData, DEFAULT_IPC_SIZE, 1);
+    IpcIoPushInt32(&reply, ret);
+    IpcIoPushFlatObj(&reply, &stats, sizeof(SurfaceStats));
+    SendReply(nullptr, ipcMsg, &reply);
+    return 0;
+}
+
+static int32_t OnEnableControlRing(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    IpcIo reply;
+    uint8_t tmpData[DEFAULT_IPC_SIZE];
+    IpcIoInit(&reply, tmpData, DEFAULT_IPC_SIZE, 1);
+    SurfaceBufferImpl* buffer = product->EnableControlRing();
+    if (buffer == nullptr) {
+        IpcIoPushInt32(&reply, SURFACE_ERROR_NOT_READY);
+    } else {
+        IpcIoPushInt32(&reply, SURFACE_ERROR_OK);
+        buffer->WriteToIpcIo(reply);
+    }
+    SendReply(nullptr, ipcMsg, &reply);
+    return 0;
+}
+
+static int32_t OnNotifyControlRing(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
+{
+    bool needReply = IpcIoPopBool(io);
+    product->DrainControlRing();
+    if (needReply) {
+        return OnSendReply(ipcMsg, io);
+    }
+    FreeBuffer(nullptr, ipcMsg);
+    return 0;
+}
+
 static int32_t OnSetUserData(BufferQueueProducer* product, void *ipcMsg, IpcIo *io)
 {
     size_t len = 0;
@@ -235,11 +351,20 @@ static IpcMsgHandle g_ipcMsgHandleList[] = {
     OnGetUsage,           // GET_USAGE
     OnSetUserData,        // SET_USER_DATA
     OnGetUserData,        // GET_USER_DATA
+    OnRequestBufferTimeout, // REQUEST_BUFFER_TIMEOUT
+    OnPreallocate,        // PREALLOCATE
+    OnSetAttributes,      // SET_ATTRIBUTES
+    OnGetAttributes,      // GET_ATTRIBUTES
+    OnEnableControlRing,  // ENABLE_CONTROL_RING
+    OnNotifyControlRing,  // NOTIFY_CONTROL_RING
+    OnFlushBufferAsync,   // FLUSH_BUFFER_ASYNC
+    OnGetStats,           // GET_STATS
 };
 
 BufferQueueProducer::BufferQueueProducer(BufferQueue* bufferQueue)
     : bufferQueue_(bufferQueue),
-      consumerListener_(nullptr)
+      consumerListener_(nullptr),
+      asyncFlushError_(SURFACE_ERROR_OK)
 {
 }
 BufferQueueProducer::~BufferQueueProducer()
@@ -258,6 +383,12 @@ SurfaceBufferImpl* BufferQueueProducer::RequestBuffer(uint8_t wait)
     return buffer;
 }
 
+SurfaceBufferImpl* BufferQueueProducer::RequestBuffer(uint8_t wait, int64_t timeout)
+{
+    RETURN_VAL_IF_FAIL(bufferQueue_, nullptr);
+    return bufferQueue_->RequestBuffer(wait, timeout);
+}
+
 int32_t BufferQueueProducer::EnqueueBuffer(SurfaceBufferImpl& buffer)
 {
     RETURN_VAL_IF_FAIL(bufferQueue_, SURFACE_ERROR_INVALID_PARAM);
@@ -304,6 +435,12 @@ uint8_t BufferQueueProducer::GetQueueSize()
     return bufferQueue_->GetQueueSize();
 }
 
+int32_t BufferQueueProducer::Preallocate(bool async)
+{
+    RETURN_VAL_IF_FAIL(bufferQueue_, SURFACE_ERROR_INVALID_PARAM);
+    return bufferQueue_->Preallocate(async);
+}
+
 void BufferQueueProducer::SetWidthAndHeight(uint32_t width, uint32_t height)
 {
     RETURN_IF_FAIL(bufferQueue_);
@@ -376,6 +513,35 @@ uint32_t BufferQueueProducer::GetUsage()
     return bufferQueue_->GetUsage();
 }
 
+int32_t BufferQueueProducer::SetAttributes(const SurfaceAttributes& attributes)
+{
+    RETURN_VAL_IF_FAIL(bufferQueue_, SURFACE_ERROR_INVALID_PARAM);
+    return bufferQueue_->SetAttributes(attributes);
+}
+
+int32_t BufferQueueProducer::GetAttributes(SurfaceAttributes& attributes)
+{
+    RETURN_VAL_IF_FAIL(bufferQueue_, SURFACE_ERROR_INVALID_PARAM);
+    bufferQueue_->GetAttributes(attributes);
+    return SURFACE_ERROR_OK;
+}
+
+int32_t BufferQueueProducer::GetStats(SurfaceStats& stats)
+{
+    RETURN_VAL_IF_FAIL(bufferQueue_, SURFACE_ERROR_INVALID_PARAM);
+    bufferQueue_->GetStats(stats);
+    return SURFACE_ERROR_OK;
+}
+
+void BufferQueueProducer::GetAttrSnapshot(BufferAttrSnapshot& snapshot)
+{
+    RETURN_IF_FAIL(bufferQueue_);
+    snapshot.sequence = bufferQueue_->GetAttrSequence();
+    bufferQueue_->GetAttributes(snapshot.attributes);
+    snapshot.size = bufferQueue_->GetSize();
+    snapshot.resetSequence = bufferQueue_->GetResetSequence();
+}
+
 void BufferQueueProducer::RegisterConsumerListener(IBufferConsumerListener& listener)
 {
     consumerListener_ = &listener;
@@ -386,6 +552,50 @@ void BufferQueueProducer::UnregisterConsumerListener()
     consumerListener_ = nullptr;
 }
 
+void BufferQueueProducer::SetLockFreeMode(bool enable)
+{
+    RETURN_IF_FAIL(bufferQueue_);
+    bufferQueue_->SetLockFreeMode(enable);
+}
+
+void BufferQueueProducer::SetMailboxMode(bool enable)
+{
+    RETURN_IF_FAIL(bufferQueue_);
+    bufferQueue_->SetMailboxMode(enable);
+}
+
+void BufferQueueProducer::GetLatencyStats(SurfaceLatencyStats& stats)
+{
+    RETURN_IF_FAIL(bufferQueue_);
+    bufferQueue_->GetLatencyStats(stats);
+}
+
+SurfaceBufferImpl* BufferQueueProducer::EnableControlRing()
+{
+    RETURN_VAL_IF_FAIL(bufferQueue_, nullptr);
+    return bufferQueue_->EnableControlRing();
+}
+
+void BufferQueueProducer::DrainControlRing()
+{
+    RETURN_IF_FAIL(bufferQueue_);
+    uint8_t flushed = bufferQueue_->DrainControlRing();
+    while (flushed > 0 && consumerListener_ != nullptr) {
+        consumerListener_->OnBufferAvailable();
+        flushed--;
+    }
+}
+
+void BufferQueueProducer::SetAsyncFlushError(int32_t error)
+{
+    asyncFlushError_.store(error);
+}
+
+int32_t BufferQueueProducer::TakeAsyncFlushError()
+{
+    return asyncFlushError_.exchange(SURFACE_ERROR_OK);
+}
+
 int32_t BufferQueueProducer::OnIpcMsg(void *ipcMsg, IpcIo *io)
 {
     if (ipcMsg == nullptr || io == nullptr) {
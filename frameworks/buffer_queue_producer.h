@@ -16,6 +16,7 @@
 #ifndef GRAPHIC_LITE_BUFFER_QUEUEU_PRODUCER_H
 #define GRAPHIC_LITE_BUFFER_QUEUEU_PRODUCER_H
 
+#include <atomic>
 #include "buffer_producer.h"
 #include "buffer_queue.h"
 #include "ibuffer_consumer_listener.h"
@@ -51,6 +52,14 @@ public:
      */
     SurfaceBufferImpl* RequestBuffer(uint8_t wait) override;
 
+    /**
+     * @brief Request buffer, waiting at most timeout nanoseconds when wait is set.
+     * @param [in] whether waiting or not.
+     * @param [in] timeout, the longest time to wait in nanoseconds. A negative value waits forever.
+     * @returns buffer pointer.
+     */
+    SurfaceBufferImpl* RequestBuffer(uint8_t wait, int64_t timeout) override;
+
     /**
      * @brief Flush buffer for consumer acquire. When producer flush buffer, to
      *        push to dirty list, and call back to consumer that buffer is available to acquire.
@@ -87,6 +96,13 @@ public:
      */
     uint8_t GetQueueSize() override;
 
+    /**
+     * @brief Preallocate buffers until the allocated buffer count reaches queue size.
+     * @param [in] async, whether allocate buffers in a background thread.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t Preallocate(bool async) override;
+
     /**
      * @brief Set width and height to calculate the buffer size.
      * @param [in] width, Buffer width.
@@ -165,6 +181,35 @@ public:
      */
     uint32_t GetUsage() override;
 
+    /**
+     * @brief Set all buffer attributes at once, buffer queue resets once for all changed attributes.
+     * @param [in] The buffer attributes, stride is ignored.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t SetAttributes(const SurfaceAttributes& attributes) override;
+
+    /**
+     * @brief Get all buffer attributes at once.
+     * @param [out] The buffer attributes.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t GetAttributes(SurfaceAttributes& attributes) override;
+
+    /**
+     * @brief Get the counters of buffer queue.
+     * @param [out] stats, the counters.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t GetStats(SurfaceStats& stats) override;
+
+    /**
+     * @brief Get all buffer attributes, the current buffer size and the attributes sequence.
+     *        The sequence is read first, so a stale snapshot never carries a newer sequence. The reset sequence is
+     *        read after the attributes, which are read under the queue lock, so it is never older than the sequence.
+     * @param [out] The buffer attributes snapshot.
+     */
+    void GetAttrSnapshot(BufferAttrSnapshot& snapshot);
+
     /**
      * @brief Set user data. Construct a local map to store all the user-data.
      * @param [in] key.
@@ -192,6 +237,47 @@ public:
      */
     void UnregisterConsumerListener();
 
+    /**
+     * @brief Set lock free mode of buffer queue, for one producer thread and one consumer thread in one process.
+     * @param [in] enable, whether lock free mode is enabled.
+     */
+    void SetLockFreeMode(bool enable);
+
+    /**
+     * @brief Set mailbox mode of buffer queue, the latest flushed buffer replaces the one not acquired yet.
+     * @param [in] enable, whether mailbox mode is enabled.
+     */
+    void SetMailboxMode(bool enable);
+
+    /**
+     * @brief Get the latency histograms of buffer queue.
+     * @param [out] stats, the latency histograms.
+     */
+    void GetLatencyStats(SurfaceLatencyStats& stats);
+
+    /**
+     * @brief Enable control ring of buffer queue for the producer in another process.
+     * @returns The shared buffer which holds the control ring, nullptr if failed.
+     */
+    SurfaceBufferImpl* EnableControlRing();
+
+    /**
+     * @brief Drain control ring of buffer queue, and notify consumer once for each flushed buffer.
+     */
+    void DrainControlRing();
+
+    /**
+     * @brief Keep the error of an asynchronous flush, which is reported with the next request buffer reply.
+     * @param [in] error, the flush error.
+     */
+    void SetAsyncFlushError(int32_t error);
+
+    /**
+     * @brief Take the error of the last failed asynchronous flush, and clear it.
+     * @returns The flush error, 0 if no asynchronous flush failed.
+     */
+    int32_t TakeAsyncFlushError();
+
     /**
      * @brief Deal with the ipc msg from BufferClientProducer.
      * @param [in] ipcMsg, ipc msg, contains request code...
@@ -203,6 +289,8 @@ public:
 private:
     BufferQueue* bufferQueue_;
     IBufferConsumerListener* consumerListener_;
+    /* Set by the one-way flush handler and taken by the request handler, which run on different ipc threads. */
+    std::atomic<int32_t> asyncFlushError_;
 };
 } // end namespace
 #endif
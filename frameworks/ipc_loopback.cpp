@@ -0,0 +1,522 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Loopback stand-in of the liteipc transport, built instead of the liteipc driver when surface_ipc_loopback is
+ * set. Only the transport is replaced, IpcIo is still serialized by liteipc. The functions are hidden in the
+ * surface library, so other users of liteipc in the same process are not affected.
+ *
+ * A service registered in this process is called directly on the caller thread. A service of another process
+ * is called through a unix socket, which is named by the process id kept in the token of SvcIdentity, so a
+ * surface written by WriteIoIpcIo could be opened by another local process.
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "buffer_common.h"
+#include "liteipc_adapter.h"
+#include "securec.h"
+
+#define LOOPBACK_API extern "C" __attribute__((visibility("hidden")))
+
+namespace OHOS {
+const uint32_t LOOPBACK_MSG_MAGIC = 0x4c424d53; // "LBMS"
+const uint32_t LOOPBACK_BUFFER_MAGIC = 0x4c424246; // "LBBF"
+const uint32_t LOOPBACK_MAX_OBJECTS = 64;
+const uint32_t LOOPBACK_MAX_DATA_SIZE = 0x100000; // 1 MB
+const int32_t LOOPBACK_LISTEN_BACKLOG = 16;
+const char LOOPBACK_SOCKET_PREFIX[] = "graphic_surface_ipc.";
+
+/* Payload follows the header, in the layout of IpcIoInit: offsets of special objects, then data. */
+struct LoopbackBuffer {
+    uint32_t magic;
+    uint32_t objectCount;
+    uint32_t dataSize;
+};
+
+struct LoopbackMsg {
+    uint32_t magic;
+    uint32_t code;
+    uint32_t flag;
+    LoopbackBuffer* reply;
+};
+
+struct LoopbackRequest {
+    uint32_t handle;
+    uint32_t code;
+    uint32_t flag;
+    uint32_t objectCount;
+    uint32_t dataSize;
+};
+
+struct LoopbackReply {
+    int32_t ret;
+    uint32_t objectCount;
+    uint32_t dataSize;
+};
+
+struct LoopbackHandler {
+    IpcMsgHandler func;
+    void* arg;
+};
+
+struct LoopbackConnection {
+    ~LoopbackConnection()
+    {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    pid_t pid = 0;
+    int32_t fd = -1;
+};
+
+static pthread_mutex_t g_handlerLock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<uint32_t, LoopbackHandler> g_handlers;
+static uint32_t g_nextHandle = 1;
+static pid_t g_listenerPid = 0;
+static thread_local LoopbackConnection g_connection;
+
+static size_t PayloadSize(uint32_t objectCount, uint32_t dataSize)
+{
+    return objectCount * sizeof(size_t) + dataSize;
+}
+
+static char* Payload(LoopbackBuffer* buffer)
+{
+    return reinterpret_cast<char*>(buffer + 1);
+}
+
+static LoopbackBuffer* AllocBuffer(uint32_t objectCount, uint32_t dataSize)
+{
+    if (objectCount > LOOPBACK_MAX_OBJECTS || dataSize > LOOPBACK_MAX_DATA_SIZE) {
+        GRAPHIC_LOGE("Ipc data is too large, objects=%u, size=%u", objectCount, dataSize);
+        return nullptr;
+    }
+    size_t size = sizeof(LoopbackBuffer) + PayloadSize(objectCount, dataSize);
+    LoopbackBuffer* buffer = static_cast<LoopbackBuffer*>(malloc(size));
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    buffer->magic = LOOPBACK_BUFFER_MAGIC;
+    buffer->objectCount = objectCount;
+    buffer->dataSize = dataSize;
+    return buffer;
+}
+
+static LoopbackBuffer* PackIpcIo(const IpcIo* io)
+{
+    uint32_t objectCount = static_cast<uint32_t>(io->offsetsCur - io->offsetsBase);
+    uint32_t dataSize = static_cast<uint32_t>(io->bufferCur - io->bufferBase);
+    LoopbackBuffer* buffer = AllocBuffer(objectCount, dataSize);
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    char* payload = Payload(buffer);
+    size_t offsetsSize = objectCount * sizeof(size_t);
+    if ((offsetsSize != 0 && memcpy_s(payload, offsetsSize, io->offsetsBase, offsetsSize) != EOK) ||
+        (dataSize != 0 && memcpy_s(payload + offsetsSize, dataSize, io->bufferBase, dataSize) != EOK)) {
+        free(buffer);
+        return nullptr;
+    }
+    return buffer;
+}
+
+static void UnpackIpcIo(LoopbackBuffer* buffer, IpcIo* io)
+{
+    IpcIoInit(io, Payload(buffer), PayloadSize(buffer->objectCount, buffer->dataSize), buffer->objectCount);
+}
+
+static int32_t Dispatch(uint32_t handle, uint32_t code, uint32_t flag, LoopbackBuffer* data, LoopbackBuffer** reply)
+{
+    pthread_mutex_lock(&g_handlerLock);
+    std::map<uint32_t, LoopbackHandler>::iterator iter = g_handlers.find(handle);
+    if (iter == g_handlers.end()) {
+        pthread_mutex_unlock(&g_handlerLock);
+        GRAPHIC_LOGW("No ipc callback of handle(%u)", handle);
+        return LITEIPC_EINVAL;
+    }
+    LoopbackHandler handler = iter->second;
+    pthread_mutex_unlock(&g_handlerLock);
+
+    IpcIo io;
+    UnpackIpcIo(data, &io);
+    LoopbackMsg msg = { LOOPBACK_MSG_MAGIC, code, flag, nullptr };
+    handler.func(nullptr, &msg, &io, handler.arg);
+    msg.magic = 0;
+    if (flag == LITEIPC_FLAG_ONEWAY) {
+        free(msg.reply);
+        return LITEIPC_OK;
+    }
+    if (msg.reply == nullptr) {
+        GRAPHIC_LOGW("Ipc callback of handle(%u) did not reply, code=%u", handle, code);
+        return LITEIPC_EINTNL;
+    }
+    *reply = msg.reply;
+    return LITEIPC_OK;
+}
+
+static bool SendAll(int32_t fd, const void* data, size_t size)
+{
+    const char* cur = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t ret = send(fd, cur, size, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        cur += ret;
+        size -= static_cast<size_t>(ret);
+    }
+    return true;
+}
+
+static bool RecvAll(int32_t fd, void* data, size_t size)
+{
+    char* cur = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t ret = recv(fd, cur, size, 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        cur += ret;
+        size -= static_cast<size_t>(ret);
+    }
+    return true;
+}
+
+static LoopbackBuffer* RecvBuffer(int32_t fd, uint32_t objectCount, uint32_t dataSize)
+{
+    LoopbackBuffer* buffer = AllocBuffer(objectCount, dataSize);
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    if (!RecvAll(fd, Payload(buffer), PayloadSize(objectCount, dataSize))) {
+        free(buffer);
+        return nullptr;
+    }
+    return buffer;
+}
+
+static bool GetSocketAddress(pid_t pid, sockaddr_un& addr, socklen_t& len)
+{
+    (void)memset_s(&addr, sizeof(addr), 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    /* Abstract socket, the name starts with '\0' and leaves no file behind. */
+    int32_t ret = snprintf_s(addr.sun_path + 1, sizeof(addr.sun_path) - 1, sizeof(addr.sun_path) - 2, "%s%d",
+        LOOPBACK_SOCKET_PREFIX, static_cast<int32_t>(pid));
+    if (ret < 0) {
+        return false;
+    }
+    len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + ret);
+    return true;
+}
+
+static void* ConnectionThread(void* arg)
+{
+    int32_t fd = static_cast<int32_t>(reinterpret_cast<intptr_t>(arg));
+    LoopbackRequest request;
+    while (RecvAll(fd, &request, sizeof(request))) {
+        LoopbackBuffer* data = RecvBuffer(fd, request.objectCount, request.dataSize);
+        if (data == nullptr) {
+            break;
+        }
+        LoopbackBuffer* replyData = nullptr;
+        int32_t ret = Dispatch(request.handle, request.code, request.flag, data, &replyData);
+        free(data);
+        if (request.flag == LITEIPC_FLAG_ONEWAY) {
+            continue;
+        }
+        LoopbackReply reply = { ret, 0, 0 };
+        if (replyData != nullptr) {
+            reply.objectCount = replyData->objectCount;
+            reply.dataSize = replyData->dataSize;
+        }
+        bool sent = SendAll(fd, &reply, sizeof(reply)) && (replyData == nullptr ||
+            SendAll(fd, Payload(replyData), PayloadSize(replyData->objectCount, replyData->dataSize)));
+        free(replyData);
+        if (!sent) {
+            break;
+        }
+    }
+    close(fd);
+    return nullptr;
+}
+
+static void* ListenerThread(void* arg)
+{
+    int32_t listenFd = static_cast<int32_t>(reinterpret_cast<intptr_t>(arg));
+    while (true) {
+        int32_t fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            GRAPHIC_LOGE("Loopback ipc accept failed, errno=%d", errno);
+            break;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, ConnectionThread, reinterpret_cast<void*>(static_cast<intptr_t>(fd))) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    close(listenFd);
+    return nullptr;
+}
+
+/* Called with g_handlerLock held. A forked child starts its own listener on its first registration. */
+static void StartListener()
+{
+    pid_t pid = getpid();
+    if (g_listenerPid == pid) {
+        return;
+    }
+    sockaddr_un addr;
+    socklen_t len = 0;
+    if (!GetSocketAddress(pid, addr, len)) {
+        return;
+    }
+    int32_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        GRAPHIC_LOGW("Loopback ipc socket failed, errno=%d", errno);
+        return;
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 || listen(fd, LOOPBACK_LISTEN_BACKLOG) != 0) {
+        GRAPHIC_LOGW("Loopback ipc listen failed, errno=%d", errno);
+        goto ERROR;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, ListenerThread, reinterpret_cast<void*>(static_cast<intptr_t>(fd))) != 0) {
+        goto ERROR;
+    }
+    pthread_detach(thread);
+    g_listenerPid = pid;
+    return;
+
+ERROR:
+    close(fd);
+    GRAPHIC_LOGW("Loopback ipc of other processes is not supported.");
+}
+
+static void Disconnect()
+{
+    if (g_connection.fd >= 0) {
+        close(g_connection.fd);
+        g_connection.fd = -1;
+    }
+}
+
+static int32_t Connect(pid_t pid)
+{
+    if (g_connection.fd >= 0 && g_connection.pid == pid) {
+        return g_connection.fd;
+    }
+    Disconnect();
+    sockaddr_un addr;
+    socklen_t len = 0;
+    if (!GetSocketAddress(pid, addr, len)) {
+        return -1;
+    }
+    int32_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+        GRAPHIC_LOGW("Connect loopback ipc of process(%d) failed, errno=%d", static_cast<int32_t>(pid), errno);
+        close(fd);
+        return -1;
+    }
+    g_connection.pid = pid;
+    g_connection.fd = fd;
+    return fd;
+}
+
+static int32_t RemoteTransact(pid_t pid, const LoopbackRequest& request, LoopbackBuffer* data,
+    LoopbackBuffer** reply)
+{
+    int32_t fd = Connect(pid);
+    if (fd < 0) {
+        return LITEIPC_EINVAL;
+    }
+    if (!SendAll(fd, &request, sizeof(request)) ||
+        !SendAll(fd, Payload(data), PayloadSize(data->objectCount, data->dataSize))) {
+        Disconnect();
+        return LITEIPC_EINTNL;
+    }
+    if (request.flag == LITEIPC_FLAG_ONEWAY) {
+        return LITEIPC_OK;
+    }
+    LoopbackReply replyHeader;
+    if (!RecvAll(fd, &replyHeader, sizeof(replyHeader))) {
+        Disconnect();
+        return LITEIPC_EINTNL;
+    }
+    if (replyHeader.ret != LITEIPC_OK) {
+        return replyHeader.ret;
+    }
+    *reply = RecvBuffer(fd, replyHeader.objectCount, replyHeader.dataSize);
+    if (*reply == nullptr) {
+        Disconnect();
+        return LITEIPC_EINTNL;
+    }
+    return LITEIPC_OK;
+}
+} // end namespace
+
+using namespace OHOS;
+
+LOOPBACK_API int32_t Transact(const IpcContext* context, SvcIdentity sid, uint32_t code, IpcIo* data, IpcIo* reply,
+    IpcFlag flag, uintptr_t* buffer)
+{
+    (void)context;
+    if (data == nullptr || (flag != LITEIPC_FLAG_ONEWAY && (reply == nullptr || buffer == nullptr))) {
+        return LITEIPC_EINVAL;
+    }
+    LoopbackBuffer* request = PackIpcIo(data);
+    if (request == nullptr) {
+        return LITEIPC_EINVAL;
+    }
+    LoopbackBuffer* replyData = nullptr;
+    int32_t ret;
+    pid_t pid = static_cast<pid_t>(sid.token);
+    if (pid == getpid()) {
+        ret = Dispatch(sid.handle, code, flag, request, &replyData);
+    } else {
+        LoopbackRequest header = { sid.handle, code, static_cast<uint32_t>(flag), request->objectCount,
+            request->dataSize };
+        ret = RemoteTransact(pid, header, request, &replyData);
+    }
+    free(request);
+    if (ret != LITEIPC_OK || flag == LITEIPC_FLAG_ONEWAY) {
+        return ret;
+    }
+    UnpackIpcIo(replyData, reply);
+    *buffer = reinterpret_cast<uintptr_t>(replyData);
+    return LITEIPC_OK;
+}
+
+LOOPBACK_API int32_t SendReply(const IpcContext* context, void* ipcMsg, IpcIo* reply)
+{
+    (void)context;
+    LoopbackMsg* msg = static_cast<LoopbackMsg*>(ipcMsg);
+    if (msg == nullptr || msg->magic != LOOPBACK_MSG_MAGIC || reply == nullptr) {
+        return LITEIPC_EINVAL;
+    }
+    LoopbackBuffer* buffer = PackIpcIo(reply);
+    if (buffer == nullptr) {
+        return LITEIPC_EINVAL;
+    }
+    free(msg->reply);
+    msg->reply = buffer;
+    return LITEIPC_OK;
+}
+
+LOOPBACK_API int32_t FreeBuffer(const IpcContext* context, void* ptr)
+{
+    (void)context;
+    if (ptr == nullptr) {
+        return LITEIPC_EINVAL;
+    }
+    uint32_t magic = *static_cast<uint32_t*>(ptr);
+    if (magic == LOOPBACK_MSG_MAGIC) {
+        /* Messages are owned by the dispatcher, and released when the callback returns. */
+        return LITEIPC_OK;
+    }
+    if (magic != LOOPBACK_BUFFER_MAGIC) {
+        return LITEIPC_EINVAL;
+    }
+    static_cast<LoopbackBuffer*>(ptr)->magic = 0;
+    free(ptr);
+    return LITEIPC_OK;
+}
+
+LOOPBACK_API int32_t GetCode(const void* ipcMsg, uint32_t* code)
+{
+    const LoopbackMsg* msg = static_cast<const LoopbackMsg*>(ipcMsg);
+    if (msg == nullptr || msg->magic != LOOPBACK_MSG_MAGIC || code == nullptr) {
+        return LITEIPC_EINVAL;
+    }
+    *code = msg->code;
+    return LITEIPC_OK;
+}
+
+LOOPBACK_API int32_t GetFlag(const void* ipcMsg, uint32_t* flag)
+{
+    const LoopbackMsg* msg = static_cast<const LoopbackMsg*>(ipcMsg);
+    if (msg == nullptr || msg->magic != LOOPBACK_MSG_MAGIC || flag == nullptr) {
+        return LITEIPC_EINVAL;
+    }
+    *flag = msg->flag;
+    return LITEIPC_OK;
+}
+
+LOOPBACK_API int32_t RegisterIpcCallback(IpcMsgHandler func, uint32_t mode, uint32_t timeoutMs, SvcIdentity* sid,
+    void* arg)
+{
+    (void)mode;
+    (void)timeoutMs;
+    if (func == nullptr || sid == nullptr) {
+        return LITEIPC_EINVAL;
+    }
+    pthread_mutex_lock(&g_handlerLock);
+    uint32_t handle = g_nextHandle++;
+    LoopbackHandler handler = { func, arg };
+    g_handlers[handle] = handler;
+    StartListener();
+    pthread_mutex_unlock(&g_handlerLock);
+
+    (void)memset_s(sid, sizeof(SvcIdentity), 0, sizeof(SvcIdentity));
+    sid->handle = handle;
+    sid->token = static_cast<uint32_t>(getpid());
+    return LITEIPC_OK;
+}
+
+LOOPBACK_API int32_t UnregisterIpcCallback(SvcIdentity sid)
+{
+    pthread_mutex_lock(&g_handlerLock);
+    size_t erased = g_handlers.erase(sid.handle);
+    pthread_mutex_unlock(&g_handlerLock);
+    return (erased != 0) ? LITEIPC_OK : LITEIPC_EINVAL;
+}
+
+#ifdef __LINUX__
+LOOPBACK_API int32_t BinderAcquire(const IpcContext* context, uint32_t handle)
+{
+    (void)context;
+    (void)handle;
+    return LITEIPC_OK;
+}
+
+LOOPBACK_API int32_t BinderRelease(const IpcContext* context, uint32_t handle)
+{
+    (void)context;
+    (void)handle;
+    return LITEIPC_OK;
+}
+#endif
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "soft_gralloc.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "buffer_common.h"
+#include "securec.h"
+#include "surface_type.h"
+
+namespace OHOS {
+const uint32_t SOFT_GRALLOC_STRIDE_ALIGNMENT = 4;
+const uint32_t SOFT_GRALLOC_MAX_SIZE = SURFACE_MAX_SIZE;
+const int32_t SOFT_GRALLOC_SHM_MODE = 0600;
+
+static GrallocFuncs g_softGrallocFuncs;
+
+static bool GetPixelSize(PixelFormat format, uint32_t& bytesPerPixel, bool& isYuv)
+{
+    isYuv = false;
+    switch (format) {
+        case PIXEL_FMT_RGB_565:
+        case PIXEL_FMT_RGBA_5551:
+            bytesPerPixel = 2; // 2 : bytes of 16 bits pixel
+            break;
+        case PIXEL_FMT_RGB_888:
+            bytesPerPixel = 3; // 3 : bytes of 24 bits pixel
+            break;
+        case PIXEL_FMT_RGBA_8888:
+            bytesPerPixel = 4; // 4 : bytes of 32 bits pixel
+            break;
+        case PIXEL_FMT_YCBCR_420_SP:
+        case PIXEL_FMT_YCRCB_420_SP:
+        case PIXEL_FMT_YCBCR_420_P:
+        case PIXEL_FMT_YCRCB_420_P:
+            bytesPerPixel = 1;
+            isYuv = true;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static bool GetAllocSize(const AllocInfo& info, uint32_t& stride, uint32_t& size)
+{
+    if ((info.usage & HBM_USE_ASSIGN_SIZE) != 0) {
+        stride = 0;
+        size = info.expectedSize;
+        return size != 0 && size <= SOFT_GRALLOC_MAX_SIZE;
+    }
+    uint32_t bytesPerPixel = 0;
+    bool isYuv = false;
+    if (info.width == 0 || info.height == 0 || !GetPixelSize(info.format, bytesPerPixel, isYuv)) {
+        return false;
+    }
+    uint64_t alignedStride = (static_cast<uint64_t>(info.width) * bytesPerPixel + SOFT_GRALLOC_STRIDE_ALIGNMENT - 1) /
+        SOFT_GRALLOC_STRIDE_ALIGNMENT * SOFT_GRALLOC_STRIDE_ALIGNMENT;
+    uint64_t total = alignedStride * info.height;
+    if (isYuv) {
+        /* Chroma planes of 4:2:0 formats take half the luma plane. */
+        total += (total + 1) / 2; // 2 : chroma is subsampled in both directions
+    }
+    if (total > SOFT_GRALLOC_MAX_SIZE) {
+        return false;
+    }
+    stride = static_cast<uint32_t>(alignedStride);
+    size = static_cast<uint32_t>(total);
+    return true;
+}
+
+static int32_t SoftAllocMem(const AllocInfo* info, BufferHandle** handle)
+{
+    if (info == nullptr || handle == nullptr) {
+        return DISPLAY_FAILURE;
+    }
+    uint32_t stride = 0;
+    uint32_t size = 0;
+    if (!GetAllocSize(*info, stride, size)) {
+        GRAPHIC_LOGE("Invalid alloc info, width=%u, height=%u, format=%d", info->width, info->height, info->format);
+        return DISPLAY_FAILURE;
+    }
+    BufferHandle* bufferHandle = static_cast<BufferHandle*>(malloc(sizeof(BufferHandle)));
+    if (bufferHandle == nullptr) {
+        return DISPLAY_FAILURE;
+    }
+    int32_t key = shmget(IPC_PRIVATE, size, IPC_CREAT | SOFT_GRALLOC_SHM_MODE);
+    if (key < 0) {
+        GRAPHIC_LOGE("Alloc shared memory failed, size=%u", size);
+        free(bufferHandle);
+        return DISPLAY_FAILURE;
+    }
+    void* virAddr = shmat(key, nullptr, 0);
+    if (virAddr == reinterpret_cast<void*>(-1)) {
+        GRAPHIC_LOGE("Map shared memory failed, key=%d", key);
+        shmctl(key, IPC_RMID, nullptr);
+        free(bufferHandle);
+        return DISPLAY_FAILURE;
+    }
+    (void)memset_s(bufferHandle, sizeof(BufferHandle), 0, sizeof(BufferHandle));
+    bufferHandle->fd = -1;
+    bufferHandle->width = static_cast<int32_t>(info->width);
+    bufferHandle->stride = static_cast<int32_t>(stride);
+    bufferHandle->height = static_cast<int32_t>(info->height);
+    bufferHandle->size = static_cast<int32_t>(size);
+    bufferHandle->format = info->format;
+    bufferHandle->usage = info->usage;
+    bufferHandle->virAddr = virAddr;
+    bufferHandle->key = key;
+    bufferHandle->phyAddr = 0;
+    *handle = bufferHandle;
+    return DISPLAY_SUCCESS;
+}
+
+static void SoftFreeMem(BufferHandle* handle)
+{
+    if (handle == nullptr) {
+        return;
+    }
+    if (handle->virAddr != nullptr) {
+        shmdt(handle->virAddr);
+    }
+    /* The segment is destroyed after the last process detaches it. */
+    shmctl(handle->key, IPC_RMID, nullptr);
+    free(handle);
+}
+
+static void* SoftMmap(BufferHandle* handle)
+{
+    if (handle == nullptr) {
+        return nullptr;
+    }
+    if (handle->virAddr != nullptr) {
+        /* Mapping the handle again replaces its address, detach the old one so the attach does not leak. */
+        shmdt(handle->virAddr);
+        handle->virAddr = nullptr;
+    }
+    void* virAddr = shmat(handle->key, nullptr, 0);
+    if (virAddr == reinterpret_cast<void*>(-1)) {
+        GRAPHIC_LOGE("Map shared memory failed, key=%d", handle->key);
+        return nullptr;
+    }
+    handle->virAddr = virAddr;
+    return virAddr;
+}
+
+static int32_t SoftUnmap(BufferHandle* handle)
+{
+    if (handle == nullptr || handle->virAddr == nullptr) {
+        return DISPLAY_FAILURE;
+    }
+    if (shmdt(handle->virAddr) != 0) {
+        return DISPLAY_FAILURE;
+    }
+    handle->virAddr = nullptr;
+    return DISPLAY_SUCCESS;
+}
+
+static int32_t SoftFlushCache(BufferHandle* handle)
+{
+    /* Shared memory is coherent between processes, a fence orders the writes before the buffer is handed over. */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return (handle != nullptr) ? DISPLAY_SUCCESS : DISPLAY_FAILURE;
+}
+
+int32_t SoftGrallocInitialize(GrallocFuncs** funcs)
+{
+    if (funcs == nullptr) {
+        return DISPLAY_FAILURE;
+    }
+    (void)memset_s(&g_softGrallocFuncs, sizeof(GrallocFuncs), 0, sizeof(GrallocFuncs));
+    g_softGrallocFuncs.AllocMem = SoftAllocMem;
+    g_softGrallocFuncs.FreeMem = SoftFreeMem;
+    g_softGrallocFuncs.Mmap = SoftMmap;
+    g_softGrallocFuncs.MmapCache = SoftMmap;
+    g_softGrallocFuncs.Unmap = SoftUnmap;
+    g_softGrallocFuncs.FlushCache = SoftFlushCache;
+    g_softGrallocFuncs.FlushMCache = SoftFlushCache;
+    *funcs = &g_softGrallocFuncs;
+    return DISPLAY_SUCCESS;
+}
+
+int32_t SoftGrallocUninitialize(GrallocFuncs* funcs)
+{
+    return (funcs == &g_softGrallocFuncs) ? DISPLAY_SUCCESS : DISPLAY_FAILURE;
+}
+} // end namespace
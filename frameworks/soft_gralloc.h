@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRAPHIC_LITE_SOFT_GRALLOC_H
+#define GRAPHIC_LITE_SOFT_GRALLOC_H
+
+#include "display_gralloc.h"
+
+namespace OHOS {
+/**
+ * @brief Get the software allocator backend, which allocates all buffers from System V shared memory, so
+ *        surfaces run on a host without vendor display driver. The shared memory id is the buffer key, any
+ *        process could map the buffer by key. There is no physically contiguous memory, physical address of
+ *        buffers is 0 and cache operations are memory fences.
+ *        Segments are marked for removal only by FreeMem, so the segments of a process that exits without freeing
+ *        its buffers, e.g. a crashed test, stay in the system until they are removed by ipcrm.
+ * @param [out] funcs, the allocator functions.
+ * @returns DISPLAY_SUCCESS if succeed.
+ */
+int32_t SoftGrallocInitialize(GrallocFuncs** funcs);
+
+/**
+ * @brief Release the software allocator backend.
+ * @param [in] funcs, the allocator functions got by SoftGrallocInitialize.
+ * @returns DISPLAY_SUCCESS if succeed.
+ */
+int32_t SoftGrallocUninitialize(GrallocFuncs* funcs);
+} // end namespace
+#endif
@@ -15,14 +15,70 @@
 
 #include "surface_buffer_impl.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <utility>
 #include "securec.h"
 
 namespace OHOS {
 const uint16_t MAX_USER_DATA_COUNT = 1000;
+const uint16_t SURFACE_BUFFER_WIRE_VERSION = 3;
+const uint32_t SURFACE_BUFFER_WIRE_INLINE_SIZE = 256;
+const uint32_t SURFACE_BUFFER_BLOB_ARENA_MIN_SIZE = 64;
+/* Flat object is pushed with its size and aligned to 4 bytes. */
+const uint32_t SURFACE_BUFFER_IPC_RESERVED_SIZE = 8;
 
-SurfaceBufferImpl::SurfaceBufferImpl() : len_(0)
+/*
+ * Wire format of buffer over ipc: one flat object of a header followed by extDataCount entries, then blobSize bytes
+ * of blobs located by blob entries, then damageCount damage rectangles. Fields are only appended in newer versions,
+ * readers locate entries by headerSize and entrySize, and damage rectangles by damageRectSize.
+ */
+struct SurfaceBufferWireHeader {
+    uint16_t version;
+    uint16_t headerSize;
+    uint16_t entrySize;
+    uint16_t extDataCount;
+    uint64_t phyAddr;
+    int32_t key;
+    uint32_t reserveFds;
+    uint32_t reserveInts;
+    uint32_t size;
+    uint32_t usage;
+    uint32_t generation;
+    uint32_t len;
+    uint8_t slot;
+    uint8_t reserved[3];
+    uint32_t blobSize; /* since version 2 */
+    uint32_t blobReserved;
+    uint32_t damageCount; /* since version 3 */
+    uint32_t damageRectSize;
+};
+
+/* Size of header in version 1, which has no blob. */
+const uint16_t SURFACE_BUFFER_WIRE_HEADER_V1_SIZE = 48;
+static_assert(offsetof(SurfaceBufferWireHeader, blobSize) == SURFACE_BUFFER_WIRE_HEADER_V1_SIZE,
+    "fields of version 1 must not change");
+
+struct SurfaceBufferWireEntry {
+    uint32_t key;
+    uint8_t type;
+    uint8_t size;
+    uint16_t reserved;
+    uint8_t value[sizeof(int64_t)];
+};
+
+SurfaceBufferImpl::SurfaceBufferImpl()
+    : heapExtDatas_(nullptr),
+      extDataCount_(0),
+      extDataCapacity_(EXTRA_DATA_INLINE_COUNT),
+      blobArena_(nullptr),
+      blobArenaUsed_(0),
+      blobArenaCapacity_(0),
+      damageCount_(0),
+      len_(0),
+      bufferHandle_(nullptr)
 {
-    struct SurfaceBufferData bufferData = {{0}, 0, 0, 0, BUFFER_STATE_NONE, NULL};
+    struct SurfaceBufferData bufferData = {{0}, 0, 0, 0, BUFFER_STATE_NONE, NULL, BUFFER_SLOT_INVALID, 0};
     bufferData_ = bufferData;
 }
 
@@ -66,43 +122,287 @@ int32_t SurfaceBufferImpl::GetInt64(uint32_t key, int64_t& value)
     return SURFACE_ERROR_OK;
 }
 
+int32_t SurfaceBufferImpl::SetBlob(uint32_t key, const void* data, uint32_t size)
+{
+    if (data == nullptr || size == 0 || size > SURFACE_BUFFER_BLOB_MAX_SIZE) {
+        GRAPHIC_LOGI("Invalid Param");
+        return SURFACE_ERROR_INVALID_PARAM;
+    }
+    uint16_t index = FindData(key);
+    ExtraData* datas = GetExtraDatas();
+    uint32_t oldSize = 0;
+    if (index < extDataCount_ && datas[index].key == key && datas[index].type == BUFFER_DATA_TYPE_BLOB) {
+        oldSize = datas[index].blob.size;
+    }
+    uint32_t arenaSize = blobArenaUsed_ - oldSize + size;
+    if (arenaSize > SURFACE_BUFFER_BLOB_ARENA_SIZE) {
+        GRAPHIC_LOGI("No more blob can be saved, size=%u", arenaSize);
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    if (!ReserveBlobArena(arenaSize)) {
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    ExtraData* extData = InsertData(key);
+    if (extData == nullptr) {
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    if (extData->type == BUFFER_DATA_TYPE_BLOB) {
+        RemoveBlob(*extData);
+    }
+    if (memcpy_s(blobArena_ + blobArenaUsed_, blobArenaCapacity_ - blobArenaUsed_, data, size) != EOK) {
+        GRAPHIC_LOGW("Couldn't copy %u bytes for blob", size);
+        extData->type = BUFFER_DATA_TYPE_NONE;
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    extData->blob.offset = blobArenaUsed_;
+    extData->blob.size = size;
+    extData->size = sizeof(extData->value);
+    extData->type = BUFFER_DATA_TYPE_BLOB;
+    blobArenaUsed_ += size;
+    return SURFACE_ERROR_OK;
+}
+
+int32_t SurfaceBufferImpl::GetBlob(uint32_t key, void* data, uint32_t& size)
+{
+    uint16_t index = FindData(key);
+    ExtraData* datas = GetExtraDatas();
+    if (index == extDataCount_ || datas[index].key != key || datas[index].type != BUFFER_DATA_TYPE_BLOB) {
+        return SURFACE_ERROR_INVALID_PARAM;
+    }
+    uint32_t capacity = size;
+    size = datas[index].blob.size;
+    if (data == nullptr) {
+        return SURFACE_ERROR_OK;
+    }
+    if (capacity < size) {
+        return SURFACE_ERROR_INVALID_PARAM;
+    }
+    if (memcpy_s(data, capacity, blobArena_ + datas[index].blob.offset, size) != EOK) {
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    return SURFACE_ERROR_OK;
+}
+
+static bool IsValidDamage(const SurfaceDamageRect& rect)
+{
+    return rect.width != 0 && rect.height != 0 && rect.x < SURFACE_MAX_WIDTH && rect.y < SURFACE_MAX_HEIGHT &&
+        rect.width <= SURFACE_MAX_WIDTH - rect.x && rect.height <= SURFACE_MAX_HEIGHT - rect.y;
+}
+
+int32_t SurfaceBufferImpl::SetDamage(const SurfaceDamageRect* rects, uint32_t count)
+{
+    if (count != 0 && rects == nullptr) {
+        GRAPHIC_LOGI("Invalid Param");
+        return SURFACE_ERROR_INVALID_PARAM;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (!IsValidDamage(rects[i])) {
+            GRAPHIC_LOGI("Invalid damage(%u, %u, %u, %u)", rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+            return SURFACE_ERROR_INVALID_PARAM;
+        }
+    }
+    damageCount_ = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        AddDamage(rects[i]);
+    }
+    return SURFACE_ERROR_OK;
+}
+
+int32_t SurfaceBufferImpl::GetDamage(SurfaceDamageRect* rects, uint32_t& count)
+{
+    uint32_t capacity = count;
+    count = damageCount_;
+    if (count == 0) {
+        return SURFACE_ERROR_OK;
+    }
+    if (rects == nullptr || capacity < count) {
+        return SURFACE_ERROR_INVALID_PARAM;
+    }
+    if (memcpy_s(rects, capacity * sizeof(SurfaceDamageRect), damageRects_, count * sizeof(SurfaceDamageRect)) != EOK) {
+        return SURFACE_ERROR_SYSTEM_ERROR;
+    }
+    return SURFACE_ERROR_OK;
+}
+
+void SurfaceBufferImpl::MergeDamage(const SurfaceBufferImpl& buffer)
+{
+    /* Whole buffer damage covers any other damage. */
+    if (damageCount_ == 0) {
+        return;
+    }
+    if (buffer.damageCount_ == 0) {
+        damageCount_ = 0;
+        return;
+    }
+    for (uint8_t i = 0; i < buffer.damageCount_; i++) {
+        AddDamage(buffer.damageRects_[i]);
+    }
+}
+
+void SurfaceBufferImpl::AddDamage(const SurfaceDamageRect& rect)
+{
+    if (damageCount_ < SURFACE_MAX_DAMAGE_COUNT) {
+        damageRects_[damageCount_++] = rect;
+        return;
+    }
+    /* Out of rectangles, the last one grows to the bounds of both, which still covers all changed pixels. */
+    SurfaceDamageRect& last = damageRects_[damageCount_ - 1];
+    uint32_t right = std::max(last.x + last.width, rect.x + rect.width);
+    uint32_t bottom = std::max(last.y + last.height, rect.y + rect.height);
+    last.x = std::min(last.x, rect.x);
+    last.y = std::min(last.y, rect.y);
+    last.width = right - last.x;
+    last.height = bottom - last.y;
+}
+
+ExtraData* SurfaceBufferImpl::GetExtraDatas()
+{
+    return (heapExtDatas_ != nullptr) ? heapExtDatas_ : inlineExtDatas_;
+}
+
+const ExtraData* SurfaceBufferImpl::GetExtraDatas() const
+{
+    return (heapExtDatas_ != nullptr) ? heapExtDatas_ : inlineExtDatas_;
+}
+
+uint16_t SurfaceBufferImpl::FindData(uint32_t key)
+{
+    /* Lower bound of the key. Entries are usually set in key order, so check the last one first. */
+    ExtraData* datas = GetExtraDatas();
+    if (extDataCount_ == 0 || datas[extDataCount_ - 1].key < key) {
+        return extDataCount_;
+    }
+    uint16_t low = 0;
+    uint16_t high = extDataCount_;
+    while (low < high) {
+        uint16_t mid = low + (high - low) / 2;
+        if (datas[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+bool SurfaceBufferImpl::ReserveExtraData(uint16_t count)
+{
+    if (count <= extDataCapacity_) {
+        return true;
+    }
+    uint16_t capacity = extDataCapacity_;
+    while (capacity < count) {
+        capacity *= 2; // 2 : grow the storage twice
+    }
+    ExtraData* datas = static_cast<ExtraData*>(malloc(capacity * sizeof(ExtraData)));
+    if (datas == nullptr) {
+        GRAPHIC_LOGE("Couldn't allocate %u ext data", capacity);
+        return false;
+    }
+    if (extDataCount_ > 0 &&
+        memcpy_s(datas, capacity * sizeof(ExtraData), GetExtraDatas(), extDataCount_ * sizeof(ExtraData)) != EOK) {
+        free(datas);
+        return false;
+    }
+    free(heapExtDatas_);
+    heapExtDatas_ = datas;
+    extDataCapacity_ = capacity;
+    return true;
+}
+
+bool SurfaceBufferImpl::ReserveBlobArena(uint32_t size)
+{
+    if (size <= blobArenaCapacity_) {
+        return true;
+    }
+    uint32_t capacity = (blobArenaCapacity_ == 0) ? SURFACE_BUFFER_BLOB_ARENA_MIN_SIZE : blobArenaCapacity_;
+    while (capacity < size) {
+        capacity *= 2; // 2 : grow the arena twice
+    }
+    uint8_t* arena = static_cast<uint8_t*>(malloc(capacity));
+    if (arena == nullptr) {
+        GRAPHIC_LOGE("Couldn't allocate %u bytes blob arena", capacity);
+        return false;
+    }
+    if (blobArenaUsed_ > 0 && memcpy_s(arena, capacity, blobArena_, blobArenaUsed_) != EOK) {
+        free(arena);
+        return false;
+    }
+    free(blobArena_);
+    blobArena_ = arena;
+    blobArenaCapacity_ = capacity;
+    return true;
+}
+
+void SurfaceBufferImpl::RemoveBlob(const ExtraData& extData)
+{
+    /* Keep the arena packed, so blobs behind the removed one move forward. */
+    uint32_t offset = extData.blob.offset;
+    uint32_t size = extData.blob.size;
+    uint32_t tail = blobArenaUsed_ - offset - size;
+    if (tail > 0 && memmove_s(blobArena_ + offset, blobArenaCapacity_ - offset, blobArena_ + offset + size,
+        tail) != EOK) {
+        GRAPHIC_LOGW("Couldn't move blob");
+    }
+    blobArenaUsed_ -= size;
+    ExtraData* datas = GetExtraDatas();
+    for (uint16_t i = 0; i < extDataCount_; i++) {
+        if (datas[i].type == BUFFER_DATA_TYPE_BLOB && datas[i].blob.offset > offset) {
+            datas[i].blob.offset -= size;
+        }
+    }
+}
+
+ExtraData* SurfaceBufferImpl::InsertData(uint32_t key)
+{
+    uint16_t index = FindData(key);
+    ExtraData* datas = GetExtraDatas();
+    if (index < extDataCount_ && datas[index].key == key) {
+        return &datas[index];
+    }
+    if (extDataCount_ > MAX_USER_DATA_COUNT) {
+        GRAPHIC_LOGI("No more data can be saved because the storage space is full.");
+        return nullptr;
+    }
+    if (!ReserveExtraData(extDataCount_ + 1)) {
+        return nullptr;
+    }
+    datas = GetExtraDatas();
+    if (index < extDataCount_ && memmove_s(&datas[index + 1], (extDataCapacity_ - index - 1) * sizeof(ExtraData),
+        &datas[index], (extDataCount_ - index) * sizeof(ExtraData)) != EOK) {
+        GRAPHIC_LOGW("Couldn't move ext data");
+        return nullptr;
+    }
+    datas[index].key = key;
+    datas[index].type = BUFFER_DATA_TYPE_NONE;
+    extDataCount_++;
+    return &datas[index];
+}
+
 int32_t SurfaceBufferImpl::SetData(uint32_t key, uint8_t type, const void* data, uint8_t size)
 {
     if (type <= BUFFER_DATA_TYPE_NONE ||
-        type >= BUFFER_DATA_TYPE_MAX ||
+        type >= BUFFER_DATA_TYPE_BLOB ||
         size <= 0 ||
         size > sizeof(int64_t)) {
         GRAPHIC_LOGI("Invalid Param");
         return SURFACE_ERROR_INVALID_PARAM;
     }
-    if (extDatas_.size() > MAX_USER_DATA_COUNT) {
-        GRAPHIC_LOGI("No more data can be saved because the storage space is full.");
+    ExtraData* entry = InsertData(key);
+    if (entry == nullptr) {
         return SURFACE_ERROR_SYSTEM_ERROR;
     }
-    ExtraData extData = {0};
-    std::map<uint32_t, ExtraData>::iterator iter = extDatas_.find(key);
-    if (iter != extDatas_.end()) {
-        extData = iter->second;
-        if (size != extData.size) {
-            free(extData.value);
-            extData.value = nullptr;
-        }
-    }
-    if (extData.value == nullptr) {
-        extData.value = malloc(size);
-        if (extData.value == nullptr) {
-            GRAPHIC_LOGE("Couldn't allocate %zu bytes for ext data", size);
-            return SURFACE_ERROR_SYSTEM_ERROR;
-        }
+    if (entry->type == BUFFER_DATA_TYPE_BLOB) {
+        RemoveBlob(*entry);
     }
-    if (memcpy_s(extData.value, size, data, size) != EOK) {
-        free(extData.value);
-        GRAPHIC_LOGW("Couldn't copy %zu bytes for ext data", size);
+    ExtraData& extData = *entry;
+    extData.value = 0;
+    if (memcpy_s(&extData.value, sizeof(extData.value), data, size) != EOK) {
+        GRAPHIC_LOGW("Couldn't copy %u bytes for ext data", size);
         return SURFACE_ERROR_SYSTEM_ERROR;
     }
     extData.size = size;
     extData.type = type;
-    extDatas_[key] = extData;
     return SURFACE_ERROR_OK;
 }
 
@@ -112,103 +412,213 @@ int32_t SurfaceBufferImpl::GetData(uint32_t key, uint8_t* type, void** data, uin
         return SURFACE_ERROR_INVALID_PARAM;
     }
 
-    std::map<uint32_t, ExtraData>::iterator iter = extDatas_.find(key);
-    if (iter == extDatas_.end()) {
+    uint16_t index = FindData(key);
+    ExtraData* datas = GetExtraDatas();
+    if (index == extDataCount_ || datas[index].key != key) {
         return SURFACE_ERROR_INVALID_PARAM;
     }
-    ExtraData extData = extDatas_[key];
-    *data = extData.value;
-    *size = extData.size;
-    *type = extData.type;
+    *data = &datas[index].value;
+    *size = datas[index].size;
+    *type = datas[index].type;
     return SURFACE_ERROR_OK;
 }
 
 void SurfaceBufferImpl::ReadFromIpcIo(IpcIo& io)
 {
-    bufferData_.handle.key =  IpcIoPopInt32(&io);
-    bufferData_.handle.phyAddr = IpcIoPopUint64(&io);
-    bufferData_.handle.reserveFds =  IpcIoPopUint32(&io);
-    bufferData_.handle.reserveInts = IpcIoPopUint32(&io);
-    bufferData_.size = IpcIoPopUint32(&io);
-    bufferData_.usage = IpcIoPopUint32(&io);
-    len_ = IpcIoPopUint32(&io);
-    uint32_t extDataSize = IpcIoPopUint32(&io);
-    if (extDataSize > 0 && extDataSize < MAX_USER_DATA_COUNT) {
-        for (uint32_t i = 0; i < extDataSize; i++) {
-            uint32_t key = IpcIoPopUint32(&io);
-            uint32_t type = IpcIoPopUint32(&io);
-            switch (type) {
-                case BUFFER_DATA_TYPE_INT_32: {
-                    int32_t value = IpcIoPopInt32(&io);
-                    SetInt32(key, value);
-                    break;
-                }
-                case BUFFER_DATA_TYPE_INT_64: {
-                    int64_t value = IpcIoPopInt64(&io);
-                    SetInt64(key, value);
-                    break;
-                }
-                default:
-                    break;
+    uint32_t dataSize = 0;
+    const uint8_t* data = static_cast<const uint8_t*>(IpcIoPopFlatObj(&io, &dataSize));
+    if (data == nullptr || dataSize < SURFACE_BUFFER_WIRE_HEADER_V1_SIZE) {
+        GRAPHIC_LOGW("Invalid buffer data, size=%u", dataSize);
+        return;
+    }
+    SurfaceBufferWireHeader header = {0};
+    if (memcpy_s(&header, sizeof(header), data, SURFACE_BUFFER_WIRE_HEADER_V1_SIZE) != EOK) {
+        return;
+    }
+    /* Newer versions only append fields, so read the known part of header and entries. */
+    if (header.version == 0 || header.headerSize < SURFACE_BUFFER_WIRE_HEADER_V1_SIZE ||
+        header.entrySize < sizeof(SurfaceBufferWireEntry) || header.extDataCount > MAX_USER_DATA_COUNT ||
+        dataSize < header.headerSize + static_cast<uint32_t>(header.extDataCount) * header.entrySize) {
+        GRAPHIC_LOGW("Invalid buffer data, version=%u, size=%u", header.version, dataSize);
+        return;
+    }
+    if (memcpy_s(&header, sizeof(header), data, std::min<uint32_t>(header.headerSize, sizeof(header))) != EOK) {
+        return;
+    }
+    uint32_t blobStart = header.headerSize + static_cast<uint32_t>(header.extDataCount) * header.entrySize;
+    if (header.blobSize > dataSize - blobStart) {
+        GRAPHIC_LOGW("Invalid buffer blob, size=%u", header.blobSize);
+        return;
+    }
+    bufferData_.handle.key = header.key;
+    bufferData_.handle.phyAddr = header.phyAddr;
+    bufferData_.handle.reserveFds = header.reserveFds;
+    bufferData_.handle.reserveInts = header.reserveInts;
+    bufferData_.size = header.size;
+    bufferData_.usage = header.usage;
+    bufferData_.slot = header.slot;
+    bufferData_.generation = header.generation;
+    len_ = header.len;
+    damageCount_ = 0;
+    uint32_t damageStart = blobStart + header.blobSize;
+    if (header.damageCount > SURFACE_MAX_DAMAGE_COUNT || (header.damageCount > 0 &&
+        (header.damageRectSize < sizeof(SurfaceDamageRect) ||
+        static_cast<uint64_t>(header.damageCount) * header.damageRectSize > dataSize - damageStart))) {
+        GRAPHIC_LOGW("Invalid buffer damage, count=%u", header.damageCount);
+    } else {
+        for (uint32_t i = 0; i < header.damageCount; i++) {
+            SurfaceDamageRect rect;
+            if (memcpy_s(&rect, sizeof(rect), data + damageStart + i * header.damageRectSize, sizeof(rect)) == EOK &&
+                IsValidDamage(rect)) {
+                AddDamage(rect);
             }
         }
     }
+    const uint8_t* entryData = data + header.headerSize;
+    for (uint16_t i = 0; i < header.extDataCount; i++, entryData += header.entrySize) {
+        SurfaceBufferWireEntry entry;
+        if (memcpy_s(&entry, sizeof(entry), entryData, sizeof(entry)) != EOK) {
+            return;
+        }
+        if (entry.type != BUFFER_DATA_TYPE_BLOB) {
+            SetData(entry.key, entry.type, entry.value, entry.size);
+            continue;
+        }
+        ExtraData location;
+        if (memcpy_s(&location.value, sizeof(location.value), entry.value, sizeof(entry.value)) != EOK ||
+            location.blob.offset > header.blobSize || location.blob.size > header.blobSize - location.blob.offset) {
+            GRAPHIC_LOGW("Invalid blob, key=%u", entry.key);
+            continue;
+        }
+        SetBlob(entry.key, data + blobStart + location.blob.offset, location.blob.size);
+    }
 }
+
+uint32_t SurfaceBufferImpl::GetIpcSize() const
+{
+    return sizeof(SurfaceBufferWireHeader) + extDataCount_ * sizeof(SurfaceBufferWireEntry) + blobArenaUsed_ +
+        damageCount_ * sizeof(SurfaceDamageRect) + SURFACE_BUFFER_IPC_RESERVED_SIZE;
+}
+
 void SurfaceBufferImpl::WriteToIpcIo(IpcIo& io)
 {
-    IpcIoPushInt32(&io, bufferData_.handle.key);
-    IpcIoPushUint64(&io, bufferData_.handle.phyAddr);
-    IpcIoPushUint32(&io, bufferData_.handle.reserveFds);
-    IpcIoPushUint32(&io, bufferData_.handle.reserveInts);
-    IpcIoPushUint32(&io, bufferData_.size);
-    IpcIoPushUint32(&io, bufferData_.usage);
-    IpcIoPushUint32(&io, len_);
-    IpcIoPushUint32(&io, extDatas_.size());
-    if (!extDatas_.empty()) {
-        std::map<uint32_t, ExtraData>::iterator iter;
-        for (iter = extDatas_.begin(); iter != extDatas_.end(); ++iter) {
-            uint32_t key = iter->first;
-            ExtraData value = iter->second;
-            IpcIoPushUint32(&io, key);
-            IpcIoPushUint32(&io, value.type);
-            switch (value.type) {
-                case BUFFER_DATA_TYPE_INT_32:
-                    IpcIoPushInt32(&io, *(reinterpret_cast<int32_t *>(value.value)));
-                    break;
-                case BUFFER_DATA_TYPE_INT_64:
-                    IpcIoPushInt64(&io, *(reinterpret_cast<int64_t *>(value.value)));
-                    break;
-                default:
-                    break;
-            }
+    uint32_t count = extDataCount_;
+    uint32_t blobStart = sizeof(SurfaceBufferWireHeader) + count * sizeof(SurfaceBufferWireEntry);
+    uint32_t damageSize = damageCount_ * sizeof(SurfaceDamageRect);
+    uint32_t dataSize = blobStart + blobArenaUsed_ + damageSize;
+    uint8_t inlineData[SURFACE_BUFFER_WIRE_INLINE_SIZE];
+    uint8_t* data = inlineData;
+    if (dataSize > SURFACE_BUFFER_WIRE_INLINE_SIZE) {
+        data = static_cast<uint8_t*>(malloc(dataSize));
+        if (data == nullptr) {
+            GRAPHIC_LOGE("Couldn't allocate %u bytes for buffer data", dataSize);
+            return;
+        }
+    }
+    /* Wire data is a byte stream with no alignment, so fill typed locals and copy them, as the reader does. */
+    SurfaceBufferWireHeader header = {0};
+    header.version = SURFACE_BUFFER_WIRE_VERSION;
+    header.headerSize = sizeof(SurfaceBufferWireHeader);
+    header.entrySize = sizeof(SurfaceBufferWireEntry);
+    header.extDataCount = count;
+    header.phyAddr = bufferData_.handle.phyAddr;
+    header.key = bufferData_.handle.key;
+    header.reserveFds = bufferData_.handle.reserveFds;
+    header.reserveInts = bufferData_.handle.reserveInts;
+    header.size = bufferData_.size;
+    header.usage = bufferData_.usage;
+    header.generation = bufferData_.generation;
+    header.len = len_;
+    header.slot = bufferData_.slot;
+    header.blobSize = blobArenaUsed_;
+    header.damageCount = damageCount_;
+    header.damageRectSize = sizeof(SurfaceDamageRect);
+    uint8_t* entryData = data + sizeof(SurfaceBufferWireHeader);
+    ExtraData* datas = GetExtraDatas();
+    for (uint16_t i = 0; i < extDataCount_; i++, entryData += sizeof(SurfaceBufferWireEntry)) {
+        SurfaceBufferWireEntry entry = {0};
+        entry.key = datas[i].key;
+        entry.type = datas[i].type;
+        entry.size = datas[i].size;
+        if (memcpy_s(entry.value, sizeof(entry.value), &datas[i].value, datas[i].size) != EOK) {
+            entry.type = BUFFER_DATA_TYPE_NONE;
         }
+        (void)memcpy_s(entryData, dataSize - (entryData - data), &entry, sizeof(entry));
+    }
+    /* The arena is packed, so blob offsets in arena are the offsets in wire blobs. */
+    if (blobArenaUsed_ > 0 && memcpy_s(data + blobStart, dataSize - blobStart, blobArena_, blobArenaUsed_) != EOK) {
+        header.blobSize = 0;
+    }
+    uint32_t damageStart = blobStart + header.blobSize;
+    if (damageSize > 0 &&
+        memcpy_s(data + damageStart, dataSize - damageStart, damageRects_, damageSize) != EOK) {
+        header.damageCount = 0;
+    }
+    (void)memcpy_s(data, dataSize, &header, sizeof(header));
+    IpcIoPushFlatObj(&io, data, dataSize);
+    if (data != inlineData) {
+        free(data);
     }
 }
 
 void SurfaceBufferImpl::CopyExtraData(SurfaceBufferImpl& buffer)
 {
+    MoveExtraData(buffer);
+}
+
+void SurfaceBufferImpl::MoveExtraData(SurfaceBufferImpl& buffer)
+{
+    if (&buffer == this) {
+        return;
+    }
     len_ = buffer.len_;
-    extDatas_ = buffer.extDatas_;
-    buffer.extDatas_.clear();
+    extDataCount_ = 0;
+    if (buffer.heapExtDatas_ != nullptr) {
+        /* The input buffer takes the storage of self, which is reused by its next extra data. */
+        std::swap(heapExtDatas_, buffer.heapExtDatas_);
+        std::swap(extDataCapacity_, buffer.extDataCapacity_);
+        extDataCount_ = buffer.extDataCount_;
+    } else if (buffer.extDataCount_ > 0 &&
+        memcpy_s(GetExtraDatas(), extDataCapacity_ * sizeof(ExtraData), buffer.inlineExtDatas_,
+        buffer.extDataCount_ * sizeof(ExtraData)) == EOK) {
+        extDataCount_ = buffer.extDataCount_;
+    }
+    std::swap(blobArena_, buffer.blobArena_);
+    std::swap(blobArenaCapacity_, buffer.blobArenaCapacity_);
+    blobArenaUsed_ = buffer.blobArenaUsed_;
+    damageCount_ = 0;
+    if (buffer.damageCount_ > 0 && memcpy_s(damageRects_, sizeof(damageRects_), buffer.damageRects_,
+        buffer.damageCount_ * sizeof(SurfaceDamageRect)) == EOK) {
+        damageCount_ = buffer.damageCount_;
+    }
+    buffer.extDataCount_ = 0;
+    buffer.blobArenaUsed_ = 0;
+    buffer.damageCount_ = 0;
 }
 
 void SurfaceBufferImpl::ClearExtraData()
 {
-    if (!extDatas_.empty()) {
-        std::map<uint32_t, ExtraData>::iterator iter;
-        for (iter = extDatas_.begin(); iter != extDatas_.end(); ++iter) {
-            ExtraData value = iter->second;
-            free(value.value);
-            value.value = nullptr;
-        }
-        extDatas_.clear();
-    }
+    /* Heap storage is kept for the next frame, which usually sets the same count of extra data. */
+    extDataCount_ = 0;
+    blobArenaUsed_ = 0;
+    damageCount_ = 0;
+}
+
+bool SurfaceBufferImpl::HasExtraData() const
+{
+    return extDataCount_ != 0 || damageCount_ != 0;
 }
 
 SurfaceBufferImpl::~SurfaceBufferImpl()
 {
     ClearExtraData();
-    struct SurfaceBufferData bufferData = {{0}, 0, 0, 0, BUFFER_STATE_NONE, NULL};
+    free(heapExtDatas_);
+    heapExtDatas_ = nullptr;
+    free(blobArena_);
+    blobArena_ = nullptr;
+    free(bufferHandle_);
+    bufferHandle_ = nullptr;
+    struct SurfaceBufferData bufferData = {{0}, 0, 0, 0, BUFFER_STATE_NONE, NULL, BUFFER_SLOT_INVALID, 0};
     bufferData_ = bufferData;
 }
 }
@@ -183,6 +183,26 @@ uint32_t SurfaceImpl::GetUsage()
     return usage;
 }
 
+int32_t SurfaceImpl::SetAttributes(const SurfaceAttributes& attributes)
+{
+    RETURN_VAL_IF_FAIL(producer_, SURFACE_ERROR_INVALID_PARAM);
+    RETURN_VAL_IF_FAIL(attributes.width > 0 && attributes.width <= SURFACE_MAX_WIDTH, SURFACE_ERROR_INVALID_PARAM);
+    RETURN_VAL_IF_FAIL(attributes.height > 0 && attributes.height <= SURFACE_MAX_HEIGHT, SURFACE_ERROR_INVALID_PARAM);
+    RETURN_VAL_IF_FAIL(attributes.strideAlignment >= SURFACE_MIN_STRIDE_ALIGNMENT &&
+        attributes.strideAlignment <= SURFACE_MAX_STRIDE_ALIGNMENT, SURFACE_ERROR_INVALID_PARAM);
+    RETURN_VAL_IF_FAIL(attributes.size < SURFACE_MAX_SIZE, SURFACE_ERROR_INVALID_PARAM);
+    RETURN_VAL_IF_FAIL(attributes.usage < BUFFER_CONSUMER_USAGE_MAX, SURFACE_ERROR_INVALID_PARAM);
+    RETURN_VAL_IF_FAIL(attributes.queueSize >= SURFACE_MIN_QUEUE_SIZE &&
+        attributes.queueSize <= SURFACE_MAX_QUEUE_SIZE, SURFACE_ERROR_INVALID_PARAM);
+    return producer_->SetAttributes(attributes);
+}
+
+int32_t SurfaceImpl::GetAttributes(SurfaceAttributes& attributes)
+{
+    RETURN_VAL_IF_FAIL(producer_, SURFACE_ERROR_INVALID_PARAM);
+    return producer_->GetAttributes(attributes);
+}
+
 void SurfaceImpl::SetQueueSize(uint8_t queueSize)
 {
     RETURN_IF_FAIL(producer_);
@@ -197,6 +217,12 @@ uint8_t SurfaceImpl::GetQueueSize()
     return queueSize;
 }
 
+int32_t SurfaceImpl::Preallocate(bool async)
+{
+    RETURN_VAL_IF_FAIL(producer_, SURFACE_ERROR_INVALID_PARAM);
+    return producer_->Preallocate(async);
+}
+
 void SurfaceImpl::SetUserData(const std::string& key, const std::string& value)
 {
     RETURN_IF_FAIL(producer_ != nullptr);
@@ -215,6 +241,12 @@ SurfaceBuffer* SurfaceImpl::RequestBuffer(uint8_t wait)
     return producer_->RequestBuffer(wait);
 }
 
+SurfaceBuffer* SurfaceImpl::RequestBuffer(uint8_t wait, int64_t timeout)
+{
+    RETURN_VAL_IF_FAIL(producer_, nullptr);
+    return producer_->RequestBuffer(wait, timeout);
+}
+
 int32_t SurfaceImpl::FlushBuffer(SurfaceBuffer* buffer)
 {
     RETURN_VAL_IF_FAIL(producer_, SURFACE_ERROR_INVALID_PARAM);
@@ -258,6 +290,61 @@ void SurfaceImpl::UnregisterConsumerListener()
     bufferQueueProducer->UnregisterConsumerListener();
 }
 
+void SurfaceImpl::SetLockFreeMode(bool enable)
+{
+    RETURN_IF_FAIL(producer_);
+    RETURN_IF_FAIL(IsConsumer_);
+    BufferQueueProducer* bufferQueueProducer = reinterpret_cast<BufferQueueProducer *>(producer_);
+    bufferQueueProducer->SetLockFreeMode(enable);
+}
+
+void SurfaceImpl::SetMailboxMode(bool enable)
+{
+    RETURN_IF_FAIL(producer_);
+    RETURN_IF_FAIL(IsConsumer_);
+    BufferQueueProducer* bufferQueueProducer = reinterpret_cast<BufferQueueProducer *>(producer_);
+    bufferQueueProducer->SetMailboxMode(enable);
+}
+
+int32_t SurfaceImpl::EnableControlRing()
+{
+    RETURN_VAL_IF_FAIL(producer_, SURFACE_ERROR_INVALID_PARAM);
+    RETURN_VAL_IF_FAIL(!IsConsumer_, SURFACE_ERROR_INVALID_REQUEST);
+    BufferClientProducer* bufferClientProducer = reinterpret_cast<BufferClientProducer *>(producer_);
+    return bufferClientProducer->EnableControlRing();
+}
+
+void SurfaceImpl::SetAsyncFlushMode(bool enable)
+{
+    RETURN_IF_FAIL(producer_);
+    RETURN_IF_FAIL(!IsConsumer_);
+    BufferClientProducer* bufferClientProducer = reinterpret_cast<BufferClientProducer *>(producer_);
+    bufferClientProducer->SetAsyncFlushMode(enable);
+}
+
+int32_t SurfaceImpl::GetAsyncFlushError()
+{
+    RETURN_VAL_IF_FAIL(producer_, SURFACE_ERROR_OK);
+    RETURN_VAL_IF_FAIL(!IsConsumer_, SURFACE_ERROR_OK);
+    BufferClientProducer* bufferClientProducer = reinterpret_cast<BufferClientProducer *>(producer_);
+    return bufferClientProducer->GetAsyncFlushError();
+}
+
+int32_t SurfaceImpl::GetLatencyStats(SurfaceLatencyStats& stats)
+{
+    RETURN_VAL_IF_FAIL(producer_, SURFACE_ERROR_INVALID_PARAM);
+    RETURN_VAL_IF_FAIL(IsConsumer_, SURFACE_ERROR_INVALID_REQUEST);
+    BufferQueueProducer* bufferQueueProducer = reinterpret_cast<BufferQueueProducer *>(producer_);
+    bufferQueueProducer->GetLatencyStats(stats);
+    return SURFACE_ERROR_OK;
+}
+
+int32_t SurfaceImpl::GetStats(SurfaceStats& stats)
+{
+    RETURN_VAL_IF_FAIL(producer_, SURFACE_ERROR_INVALID_PARAM);
+    return producer_->GetStats(stats);
+}
+
 void SurfaceImpl::WriteIoIpcIo(IpcIo& io)
 {
     IpcIoPushSvc(&io, &sid_);
@@ -43,10 +43,31 @@ typedef enum {
     GET_USAGE,
     SET_USER_DATA,
     GET_USER_DATA,
+    REQUEST_BUFFER_TIMEOUT,
+    PREALLOCATE,
+    SET_ATTRIBUTES,
+    GET_ATTRIBUTES,
+    ENABLE_CONTROL_RING,
+    NOTIFY_CONTROL_RING,
+    FLUSH_BUFFER_ASYNC,
+    GET_STATS,
     MAX_REQUEST_CODE,
 } SURFACE_REQUEST_CODE;
 } // end extern
 
+/**
+ * @brief Buffer attributes snapshot. Client producer caches it and refreshes it when the sequence changes.
+ */
+struct BufferAttrSnapshot {
+    SurfaceAttributes attributes;
+    /* Current buffer size, custom size or calculated by the attached buffer. */
+    uint32_t size;
+    /* Buffer queue bumps it whenever any attribute changes. */
+    uint32_t sequence;
+    /* Buffer queue bumps it whenever a reset detaches its buffers, client producer drops its mappings then. */
+    uint32_t resetSequence;
+};
+
 /**
  * @brief Surface producer abstract class. Provide request, flush, cancel and set buffer attr ability.
  *        In multi process, the producer is BufferClientProducer; In single process, it is BufferQueueProducer.
@@ -69,6 +90,17 @@ public:
      */
     virtual SurfaceBufferImpl* RequestBuffer(uint8_t wait) = 0;
 
+    /**
+     * @brief Request buffer. Surface producer requests buffer.
+     *        Waiting at most timeout nanoseconds until some buffer could used.
+     * @param [in] whether waiting or not.
+     *        wait = 1. waiting util get surface buffer or timeout expires.
+     *        wait = 0. No wait to get surface buffer.
+     * @param [in] timeout, the longest time to wait in nanoseconds. A negative value waits forever.
+     * @returns buffer pointer.
+     */
+    virtual SurfaceBufferImpl* RequestBuffer(uint8_t wait, int64_t timeout) = 0;
+
     /**
      * @brief Flush buffer for consumer acquire. When producer flush buffer, to
      *        push to dirty list, and call back to consumer that buffer is available to acquire.
@@ -97,6 +129,13 @@ public:
      */
     virtual uint8_t GetQueueSize() = 0;
 
+    /**
+     * @brief Preallocate buffers until the allocated buffer count reaches queue size.
+     * @param [in] async, whether allocate buffers in a background thread.
+     * @returns 0 is succeed; other is failed.
+     */
+    virtual int32_t Preallocate(bool async) = 0;
+
     /**
      * @brief Set width and height to calculate the buffer size.
      * @param [in] width, Buffer width.
@@ -175,6 +214,27 @@ public:
      */
     virtual uint32_t GetUsage() = 0;
 
+    /**
+     * @brief Set all buffer attributes at once, buffer queue resets once for all changed attributes.
+     * @param [in] The buffer attributes, stride is ignored.
+     * @returns 0 is succeed; other is failed.
+     */
+    virtual int32_t SetAttributes(const SurfaceAttributes& attributes) = 0;
+
+    /**
+     * @brief Get all buffer attributes at once.
+     * @param [out] The buffer attributes.
+     * @returns 0 is succeed; other is failed.
+     */
+    virtual int32_t GetAttributes(SurfaceAttributes& attributes) = 0;
+
+    /**
+     * @brief Get the counters of buffer queue.
+     * @param [out] stats, the counters.
+     * @returns 0 is succeed; other is failed.
+     */
+    virtual int32_t GetStats(SurfaceStats& stats) = 0;
+
     /**
      * @brief Set user data. Construct a local map to store all the user-data.
      * @param [in] key.
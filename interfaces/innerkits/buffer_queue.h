@@ -16,9 +16,11 @@
 #ifndef GRAPHIC_LITE_BUFFER_QUEUE_H
 #define GRAPHIC_LITE_BUFFER_QUEUE_H
 
-#include <list>
+#include <atomic>
+#include <ctime>
 #include <map>
 #include "surface_buffer_impl.h"
+#include "surface_type.h"
 
 namespace OHOS {
 const static int8_t SURFACE_MAX_PLANE_NUM = 4;
@@ -34,6 +36,99 @@ enum PLANE_COUNT {
     IMAGE_PIXEL_FORMAT_PLANE_COUNT_YUV4XX
 };
 
+/* Buffers marked deletePending by Reset() outlive it, so keep room for two full queues. */
+const static uint8_t BUFFER_QUEUE_SLOT_COUNT = SURFACE_MAX_QUEUE_SIZE * 2;
+
+/* Rings are indexed by free running counters, a power of two capacity keeps the index right when they wrap. */
+const static uint32_t BUFFER_RING_CAPACITY = 32;
+const static uint32_t BUFFER_RING_MASK = BUFFER_RING_CAPACITY - 1;
+static_assert((BUFFER_RING_CAPACITY & BUFFER_RING_MASK) == 0 && BUFFER_RING_CAPACITY >= BUFFER_QUEUE_SLOT_COUNT,
+    "ring capacity must be a power of two holding all slots");
+
+struct BufferSlotList {
+    uint8_t head;
+    uint8_t tail;
+    uint8_t count;
+};
+
+struct BufferSlot {
+    SurfaceBufferImpl* buffer;
+    BufferSlotList* owner; /* the free or dirty list which holds this slot, nullptr if none */
+    uint32_t generation;   /* bumped whenever the slot gets a new buffer, so stale handles miss */
+    uint32_t attachSeq;    /* the reset sequence when attached, buffers of older sequence are deletePending */
+    uint64_t stateTime;    /* the monotonic time in microseconds when the buffer state changed */
+    uint8_t prev;
+    uint8_t next;
+};
+
+/* Single producer single consumer ring of slot indices, used in lock free mode. */
+struct BufferSlotRing {
+    uint8_t slots[BUFFER_RING_CAPACITY];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+};
+
+/* One buffer handed over through the control ring, identified by slot and generation. */
+struct BufferControlEntry {
+    uint8_t slot;
+    uint8_t canceled; /* set by producer to give back a buffer it could not use */
+    uint32_t generation;
+    uint32_t resetSeq; /* the reset sequence when the buffer is pushed to free queue */
+};
+
+/* Single producer single consumer queue of control entries, placed in shared memory. */
+struct BufferControlQueue {
+    BufferControlEntry entries[BUFFER_RING_CAPACITY];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+};
+
+/*
+ * Control ring shared by buffer queue and the producer in another process. Buffer queue pushes free buffers to
+ * free queue ahead of requests, producer pushes flushed or canceled buffers to dirty queue.
+ */
+struct BufferControlRing {
+    std::atomic<uint32_t> resetSeq;
+    BufferControlQueue freeQueue;
+    BufferControlQueue dirtyQueue;
+};
+
+/*
+ * Latency histogram of buffer queue. Each histogram is recorded by one thread at a time, under the queue lock or
+ * by the only producer or consumer thread in lock free mode, and could be read by any thread.
+ */
+struct BufferLatencyHistogram {
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> buckets[SURFACE_LATENCY_BUCKET_COUNT];
+    std::atomic<uint64_t> totalUs;
+    std::atomic<uint64_t> maxUs;
+};
+
+struct BufferLatency {
+    BufferLatencyHistogram producerHold;
+    BufferLatencyHistogram queueDwell;
+    BufferLatencyHistogram consumerHold;
+    BufferLatencyHistogram requestWait;
+};
+
+/* Counters of buffer queue, updated by producer and consumer threads and read by any thread. */
+struct BufferQueueStats {
+    std::atomic<uint64_t> waitUs;
+    std::atomic<uint32_t> requestSucceeded;
+    std::atomic<uint32_t> requestFailed;
+    std::atomic<uint32_t> waits;
+    std::atomic<uint32_t> flushes;
+    std::atomic<uint32_t> acquires;
+    std::atomic<uint32_t> emptyAcquires;
+    std::atomic<uint32_t> allocs;
+    std::atomic<uint32_t> frees;
+    std::atomic<uint32_t> deletePendingDetaches;
+    std::atomic<uint32_t> peakFreeDepth;
+    std::atomic<uint32_t> peakDirtyDepth;
+    std::atomic<uint32_t> lockContentions;
+    std::atomic<uint64_t> lockWaitUs;
+};
+
 class BufferQueue {
 public:
     /**
@@ -57,6 +152,17 @@ public:
      */
     SurfaceBufferImpl* RequestBuffer(uint8_t wait);
 
+    /**
+     * @brief Request buffer, waiting at most timeout nanoseconds when wait is set.
+     * @param [in] whether waiting or not.
+     *        wait = 1. waiting util free list has buffer or timeout expires.
+     *        wait = 0. No wait, could return null pointer.
+     * @param [in] timeout, the longest time to wait in nanoseconds, measured on the monotonic clock.
+     *        A negative value waits forever.
+     * @returns buffer pointer, null pointer if no buffer can request before timeout expires.
+     */
+    SurfaceBufferImpl* RequestBuffer(uint8_t wait, int64_t timeout);
+
     /**
      * @brief Flush buffer to dirty list, for consumer acquire. When producer flush buffer, buffer
      *        will push to dirty list, and call back to consumer that buffer is available to acquire.
@@ -177,6 +283,32 @@ public:
      */
     int32_t GetUsage();
 
+    /**
+     * @brief Set all buffer attributes, buffer queue resets once for all changed attributes.
+     *        If attributes are not changed, buffers are kept. If any attribute is invalid, none is set.
+     * @param [in] The buffer attributes, stride is ignored.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t SetAttributes(const SurfaceAttributes& attributes);
+
+    /**
+     * @brief Get all buffer attributes.
+     * @param [out] The buffer attributes.
+     */
+    void GetAttributes(SurfaceAttributes& attributes);
+
+    /**
+     * @brief Get attributes sequence, which is bumped whenever any attribute changes.
+     * @returns The attributes sequence.
+     */
+    uint32_t GetAttrSequence() const;
+
+    /**
+     * @brief Get reset sequence, which is bumped whenever a reset detaches the buffers of the queue.
+     * @returns The reset sequence.
+     */
+    uint32_t GetResetSequence() const;
+
     /**
      * @brief Set user data. Construct a local map to store all the user-data.
      * @param [in] key.
@@ -190,6 +322,91 @@ public:
      */
     std::string GetUserData(const std::string& key);
 
+    /**
+     * @brief Set lock free mode. In lock free mode, free and dirty queues are single producer single consumer
+     *        rings, so request, flush, acquire and release do not take the queue lock unless producer needs to
+     *        attach buffer or wait. Only one thread could request, flush and cancel buffers, and only one thread
+     *        could acquire and release buffers. Set it before producer and consumer start.
+     * @param [in] enable, whether lock free mode is enabled.
+     */
+    void SetLockFreeMode(bool enable);
+
+    /**
+     * @brief Set mailbox mode. In mailbox mode, the dirty list keeps the latest flushed buffer only, a buffer
+     *        which is flushed but not acquired yet is pushed back to free list when a newer buffer is flushed.
+     *        In lock free mode, the stale buffers are pushed back to free list when consumer acquires.
+     * @param [in] enable, whether mailbox mode is enabled.
+     */
+    void SetMailboxMode(bool enable);
+
+    /**
+     * @brief Preallocate buffers. Attach buffers until attach count reaches queue size, so the following
+     *        requests do not allocate buffer.
+     * @param [in] async, whether allocate buffers in a background thread.
+     *        async = true. Return immediately, buffers are attached in a background thread.
+     *        async = false. Return after all buffers are attached.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t Preallocate(bool async);
+
+    /**
+     * @brief Enable control ring, which lets the producer in another process request and flush buffers
+     *        through shared memory. Not available in lock free mode.
+     * @returns The shared buffer which holds the control ring, nullptr if failed.
+     */
+    SurfaceBufferImpl* EnableControlRing();
+
+    /**
+     * @brief Take the buffers flushed or canceled by producer out of the control ring, then push free buffers
+     *        to the control ring.
+     * @returns The count of flushed buffers.
+     */
+    uint8_t DrainControlRing();
+
+    /**
+     * @brief Push entry to control queue. Only one thread pushes a queue.
+     * @param [in] queue, the control queue.
+     * @param [in] entry, the control entry.
+     * @returns false if the queue is full.
+     */
+    static bool PushControlEntry(BufferControlQueue& queue, const BufferControlEntry& entry);
+
+    /**
+     * @brief Pop entry from control queue. Only one thread pops a queue.
+     * @param [in] queue, the control queue.
+     * @param [out] entry, the control entry.
+     * @returns false if the queue is empty.
+     */
+    static bool PopControlEntry(BufferControlQueue& queue, BufferControlEntry& entry);
+
+    /**
+     * @brief Get the count of entries in control queue.
+     * @param [in] queue, the control queue.
+     * @returns The entry count.
+     */
+    static uint32_t GetControlQueueSize(const BufferControlQueue& queue);
+
+    /**
+     * @brief Get the latency histograms of buffer cycle, which are recorded whenever buffer state changes.
+     * @param [out] stats, the latency histograms.
+     */
+    void GetLatencyStats(SurfaceLatencyStats& stats) const;
+
+    /**
+     * @brief Get the counters of requests, waits, flushes, acquires, allocations and queue depth.
+     * @param [out] stats, the counters.
+     */
+    void GetStats(SurfaceStats& stats) const;
+
+    /**
+     * @brief Check the bookkeeping of buffer queue: the free, dirty and cancel lists are well linked and hold
+     *        buffers in matching states, the used slot count matches the slots, and the attach count matches the
+     *        buffers attached since the last reset. In lock free mode, call it only when no thread is using the
+     *        queue, since the rings and the cancel list are changed without the queue lock.
+     * @returns 0 is consistent; SURFACE_ERROR_SYSTEM_ERROR if any check fails.
+     */
+    int32_t CheckInvariants();
+
     /**
      * @brief Buffer queue init succeed or not.
      * @returns Whether init or not.
@@ -197,11 +414,38 @@ public:
     bool Init();
 
 private:
-    bool CanRequest(uint8_t wait);
+    void Lock();
+    bool CheckSlotList(const BufferSlotList& list, BufferState expectState, uint8_t& listedCount) const;
+    bool WaitFreeBuffer(const struct timespec* deadline);
+    bool CanRequest(uint8_t wait, const struct timespec* deadline);
+    SurfaceBufferImpl* RequestBufferLockFree(uint8_t wait, const struct timespec* deadline);
+    int32_t FlushBufferLockFree(SurfaceBufferImpl& buffer, SurfaceBufferImpl& tmpBuffer);
+    SurfaceBufferImpl* AcquireBufferLockFree();
+    void RecycleBuffer(SurfaceBufferImpl* buffer);
+    bool QueueDirtySlot(uint8_t slot);
+    void RefillControlRing();
+    void SetSlotState(uint8_t slot, BufferState state);
+    void RecordRequest(uint64_t startUs, bool succeeded);
+    void DetachDeletePending(SurfaceBufferImpl* buffer);
+    static void RecordLatency(BufferLatencyHistogram& histogram, uint64_t latencyUs);
+    static void ReadLatency(const BufferLatencyHistogram& histogram, SurfaceLatencyHistogram& stats);
+    int32_t AttachAllBuffers();
+    void JoinPreallocateThread();
+    static void* PreallocateThread(void* arg);
+    int32_t ReleaseBufferLockFree(SurfaceBufferImpl& tmpBuffer, BufferState state);
+    bool IsStale(uint8_t slot) const;
+    void PushRing(BufferSlotRing& ring, uint8_t slot);
+    uint8_t PopRing(BufferSlotRing& ring);
     int32_t isValidAttr(uint32_t width, uint32_t height, uint32_t format, uint32_t strideAlignment);
     int32_t Reset(uint32_t size = 0);
-    void NeedAttach();
+    uint8_t NeedAttach();
     void Detach(SurfaceBufferImpl* buffer);
+    uint8_t AllocSlot(SurfaceBufferImpl* buffer);
+    uint8_t FindSlot(const SurfaceBufferImpl* buffer) const;
+    void FreeSlot(uint8_t slot);
+    void PushSlot(BufferSlotList& list, uint8_t slot);
+    uint8_t PopSlot(BufferSlotList& list);
+    void RemoveSlot(uint8_t slot);
     SurfaceBufferImpl* GetBuffer(const SurfaceBufferImpl& buffer);
     int32_t ReleaseBuffer(const SurfaceBufferImpl& buffer, BufferState state);
     uint32_t width_;
@@ -214,9 +458,26 @@ private:
     uint32_t strideAlignment_;
     uint8_t attachCount_;
     bool customSize_;
-    std::list<SurfaceBufferImpl *> freeList_;
-    std::list<SurfaceBufferImpl *> dirtyList_;
-    std::list<SurfaceBufferImpl *> allBuffers_;
+    uint8_t usedSlotCount_;
+    BufferSlot slots_[BUFFER_QUEUE_SLOT_COUNT];
+    BufferSlotList freeList_;
+    BufferSlotList dirtyList_;
+    bool lockFree_;
+    bool mailbox_;
+    pthread_mutex_t preallocateLock_; /* guards preallocateThread_ and preallocateStarted_ */
+    pthread_t preallocateThread_;
+    bool preallocateStarted_;
+    BufferSlotRing freeRing_;
+    BufferSlotRing dirtyRing_;
+    BufferSlotList cancelList_;
+    std::atomic<uint32_t> resetSeq_;
+    std::atomic<uint32_t> freeWaiters_;
+    std::atomic<uint32_t> attrSeq_;
+    SurfaceBufferImpl* controlBuffer_;
+    BufferControlRing* controlRing_;
+    uint32_t requestWaiters_;
+    BufferLatency latency_;
+    BufferQueueStats stats_;
     pthread_mutex_t lock_;
     pthread_cond_t freeCond_;
     std::map<std::string, std::string> usrDataMap_;
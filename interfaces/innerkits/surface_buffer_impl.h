@@ -16,7 +16,6 @@
 #ifndef GRAPHIC_LITE_SURFACE_BUFFER_IMPL_H
 #define GRAPHIC_LITE_SURFACE_BUFFER_IMPL_H
 
-#include <map>
 #include "buffer_common.h"
 #include "liteipc_adapter.h"
 #include "serializer.h"
@@ -31,10 +30,13 @@ enum BufferState {
     BUFFER_STATE_RELEASE
 };
 
+const static uint8_t BUFFER_SLOT_INVALID = 0xFF;
+
 enum BufferDataType {
     BUFFER_DATA_TYPE_NONE,
     BUFFER_DATA_TYPE_INT_32,
     BUFFER_DATA_TYPE_INT_64,
+    BUFFER_DATA_TYPE_BLOB,
     BUFFER_DATA_TYPE_MAX,
 };
 
@@ -58,16 +60,32 @@ struct SurfaceBufferData {
     uint8_t deletePending;
     BufferState state;
     void* virAddr;
+    uint8_t slot;         /* the index of buffer queue slot which holds this buffer */
+    uint32_t generation;  /* the generation of the slot when the buffer was attached */
     bool operator == (const SurfaceBufferData &rData) const
     {
         return handle == rData.handle;
     }
 };
 
+/* Extra data entries kept inside the buffer, more entries are kept in heap storage. */
+const static uint8_t EXTRA_DATA_INLINE_COUNT = 10;
+
+/* Max size of one blob, and max size of all blobs of one buffer, which keeps a flush in one ipc message. */
+const static uint32_t SURFACE_BUFFER_BLOB_MAX_SIZE = 256;
+const static uint32_t SURFACE_BUFFER_BLOB_ARENA_SIZE = 512;
+
 typedef struct {
-    void* value;
+    uint32_t key;
     uint8_t size;
     uint8_t type;
+    union {
+        int64_t value; /* values are no longer than int64_t, so they are stored inline */
+        struct {
+            uint32_t offset;
+            uint32_t size;
+        } blob; /* location of a blob in the blob arena */
+    };
 } ExtraData;
 
 /**
@@ -85,6 +103,10 @@ public:
      */
     ~SurfaceBufferImpl();
 
+    /* Buffer owns heap extra data, blob arena and buffer handle, use MoveExtraData to hand over extra data. */
+    SurfaceBufferImpl(const SurfaceBufferImpl&) = delete;
+    SurfaceBufferImpl& operator=(const SurfaceBufferImpl&) = delete;
+
     /**
      * @brief Get buffer key, for shared virtual memory.
      * @returns The buffer key.
@@ -293,6 +315,54 @@ public:
     {
         bufferData_.state = newState;
     }
+
+    /**
+     * @brief Get buffer slot, the index of buffer queue slot which holds this buffer.
+     * @returns The buffer slot, BUFFER_SLOT_INVALID if the buffer is not attached.
+     */
+    uint8_t GetSlot() const
+    {
+        return bufferData_.slot;
+    }
+
+    /**
+     * @brief Get slot generation, which is checked with the slot to find the attached buffer.
+     * @returns The slot generation.
+     */
+    uint32_t GetGeneration() const
+    {
+        return bufferData_.generation;
+    }
+
+    /**
+     * @brief Set buffer slot and slot generation, when buffer queue attaches the buffer.
+     * @param [in] The buffer slot.
+     * @param [in] The slot generation.
+     */
+    void SetSlot(uint8_t slot, uint32_t generation)
+    {
+        bufferData_.slot = slot;
+        bufferData_.generation = generation;
+    }
+
+    /**
+     * @brief Get the buffer handle which BufferManager built for this buffer.
+     * @returns The buffer handle, null pointer if not built yet.
+     */
+    void* GetBufferHandle() const
+    {
+        return bufferHandle_;
+    }
+
+    /**
+     * @brief Set the buffer handle which BufferManager built for this buffer, it is freed with the buffer.
+     * @param [in] The buffer handle, allocated by malloc.
+     */
+    void SetBufferHandle(void* bufferHandle)
+    {
+        bufferHandle_ = bufferHandle;
+    }
+
     /**
      * @brief Set int32 extra data for buffer, like <key,value>.
      * @param [in] key, unique uint32_t. If exited, will overlap.
@@ -325,6 +395,48 @@ public:
      */
     int32_t GetInt64(uint32_t key, int64_t& value) override;
 
+    /**
+     * @brief Set blob extra data for buffer, like <key,value>. The blob is copied into the blob arena of buffer.
+     * @param [in] key, unique uint32_t. If exited, will overlap.
+     * @param [in] data, pointer of blob data.
+     * @param [in] size, blob size, no more than SURFACE_BUFFER_BLOB_MAX_SIZE.
+     * @returns if succeed, return 0; else return -1.
+     */
+    int32_t SetBlob(uint32_t key, const void* data, uint32_t size) override;
+
+    /**
+     * @brief Get blob extra data for buffer, like <key,value>.
+     * @param [in] key, unique uint32_t..
+     * @param [out] data, buffer which the blob copied to, could be nullptr to query size only.
+     * @param [in/out] size, size of data buffer as input, blob size as output.
+     * @returns if succeed, return 0; else return -1;
+     */
+    int32_t GetBlob(uint32_t key, void* data, uint32_t& size) override;
+
+    /**
+     * @brief Set damage rectangles of buffer, which replace the damage set before.
+     * @param [in] rects, pointer of damage rectangles.
+     * @param [in] count, number of rectangles, 0 means the whole buffer is damaged.
+     * @returns if succeed, return 0; else return -1.
+     */
+    int32_t SetDamage(const SurfaceDamageRect* rects, uint32_t count) override;
+
+    /**
+     * @brief Get damage rectangles of buffer.
+     * @param [out] rects, buffer which the rectangles copied to.
+     * @param [in/out] count, number of rectangles rects holds as input, number of damage rectangles as output,
+     *        0 means the whole buffer is damaged.
+     * @returns if succeed, return 0; else return -1;
+     */
+    int32_t GetDamage(SurfaceDamageRect* rects, uint32_t& count) override;
+
+    /**
+     * @brief Merge damage of an older buffer which is dropped before consumer acquires it, so the damage of self
+     *        covers the changes of both frames.
+     * @param [in] buffer, the dropped buffer.
+     */
+    void MergeDamage(const SurfaceBufferImpl& buffer);
+
     /**
      * @brief Verify the two surface buffer same or not.
      * @param [in] The other SurfaceBufferImpl object
@@ -347,17 +459,36 @@ public:
      */
     void WriteToIpcIo(IpcIo& io);
 
+    /**
+     * @brief Get the ipc data size needed by WriteToIpcIo.
+     * @returns ipc data size in bytes.
+     */
+    uint32_t GetIpcSize() const;
+
     /**
      * @brief Copy buffer extra data from input buffer to self
      * @param [in] buffer pointer.
      */
     void CopyExtraData(SurfaceBufferImpl& buffer);
 
+    /**
+     * @brief Move buffer extra data from input buffer to self, the input buffer has no extra data after moving.
+     *        Heap storage is swapped without copying entries, so moving never allocates.
+     * @param [in] buffer, the buffer which extra data moves from.
+     */
+    void MoveExtraData(SurfaceBufferImpl& buffer);
+
     /**
      * @brief Clear buffer extra data.
      */
     void ClearExtraData();
 
+    /**
+     * @brief Whether buffer has extra data or damage or not.
+     * @returns true if any extra data or damage is set.
+     */
+    bool HasExtraData() const;
+
 private:
     /**
      * Set extra data for buffer, like <key,value>.
@@ -368,9 +499,29 @@ private:
      */
     int32_t SetData(uint32_t key, uint8_t type, const void* data, uint8_t size);
     int32_t GetData(uint32_t key, uint8_t* type, void** data, uint8_t* size);
+    ExtraData* GetExtraDatas();
+    const ExtraData* GetExtraDatas() const;
+    uint16_t FindData(uint32_t key);
+    ExtraData* InsertData(uint32_t key);
+    bool ReserveExtraData(uint16_t count);
+    bool ReserveBlobArena(uint32_t size);
+    void RemoveBlob(const ExtraData& extData);
+    void AddDamage(const SurfaceDamageRect& rect);
     struct SurfaceBufferData bufferData_;
-    std::map<uint32_t, ExtraData> extDatas_;
+    /* Extra data sorted by key, in inline storage until more than EXTRA_DATA_INLINE_COUNT entries are set. */
+    ExtraData inlineExtDatas_[EXTRA_DATA_INLINE_COUNT];
+    ExtraData* heapExtDatas_;
+    uint16_t extDataCount_;
+    uint16_t extDataCapacity_;
+    /* Blobs packed without holes, kept for the next frame like heap storage of extra data. */
+    uint8_t* blobArena_;
+    uint32_t blobArenaUsed_;
+    uint32_t blobArenaCapacity_;
+    /* Damage of the frame, no rectangle means the whole buffer. */
+    SurfaceDamageRect damageRects_[SURFACE_MAX_DAMAGE_COUNT];
+    uint8_t damageCount_;
     uint32_t len_;
+    void* bufferHandle_;
 };
 } // end namespace
 #endif
@@ -62,6 +62,14 @@ public:
      */
     uint8_t GetQueueSize() override;
 
+    /**
+     * @brief Preallocate buffers until the allocated buffer count reaches queue size.
+     *        In multi process, the buffers are allocated by consumer process.
+     * @param [in] async, whether allocate buffers in a background thread.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t Preallocate(bool async = false) override;
+
     /**
      * @brief Set width and height to calculate the buffer size.
      * @param [in] width, Buffer width.
@@ -140,6 +148,21 @@ public:
      */
     uint32_t GetUsage() override;
 
+    /**
+     * @brief Set all buffer attributes at once, buffer queue resets once for all changed attributes.
+     *        In multi process, attributes are sent in one ipc message.
+     * @param [in] The buffer attributes, stride is ignored.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t SetAttributes(const SurfaceAttributes& attributes) override;
+
+    /**
+     * @brief Get all buffer attributes at once. In multi process, attributes are got in one ipc message.
+     * @param [out] The buffer attributes.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t GetAttributes(SurfaceAttributes& attributes) override;
+
     /**
      * @brief Set user data. Surface would construct a local map to store all the user-data.
      * @param [in] key.
@@ -163,6 +186,17 @@ public:
      */
     SurfaceBuffer* RequestBuffer(uint8_t wait = 0) override;
 
+    /**
+     * @brief Request buffer. Surface producer requests buffer.
+     *        Waiting at most timeout nanoseconds until some buffer could used.
+     * @param [in] whether waiting or not.
+     *        wait = 1. waiting util get surface buffer or timeout expires.
+     *        wait = 0. No wait to get surface buffer.
+     * @param [in] timeout, the longest time to wait in nanoseconds. A negative value waits forever.
+     * @returns buffer pointer.
+     */
+    SurfaceBuffer* RequestBuffer(uint8_t wait, int64_t timeout) override;
+
     /**
      * @brief Flush buffer for consumer acquire. When producer flush buffer, buffer
      *        whill push to dirty list, and call back to consumer that buffer is available to acquire.
@@ -204,6 +238,54 @@ public:
      *        there will have no listener.
      */
     void UnregisterConsumerListener() override;
+
+    /**
+     * @brief Set lock free mode, when producer and consumer are in the same process.
+     *        Only one thread could request, flush and cancel buffers, and only one thread could
+     *        acquire and release buffers.
+     * @param [in] enable, whether lock free mode is enabled.
+     */
+    void SetLockFreeMode(bool enable) override;
+
+    /**
+     * @brief Set mailbox mode. A flushed buffer replaces the buffer which is flushed but not acquired yet,
+     *        and the replaced buffer goes back to free list.
+     * @param [in] enable, whether mailbox mode is enabled.
+     */
+    void SetMailboxMode(bool enable) override;
+
+    /**
+     * @brief Enable control ring shared with consumer, only for producer in another process.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t EnableControlRing() override;
+
+    /**
+     * @brief Set asynchronous flush mode, only for producer in another process.
+     * @param [in] enable, whether asynchronous flush mode is enabled.
+     */
+    void SetAsyncFlushMode(bool enable) override;
+
+    /**
+     * @brief Get the error of the last failed asynchronous flush, and clear it.
+     * @returns The flush error, 0 if no asynchronous flush failed.
+     */
+    int32_t GetAsyncFlushError() override;
+
+    /**
+     * @brief Get the latency histograms of buffer cycle. Only consumer could get them.
+     * @param [out] stats, the latency histograms.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t GetLatencyStats(SurfaceLatencyStats& stats) override;
+
+    /**
+     * @brief Get the counters of buffer queue. In multi process, counters are got in one ipc message.
+     * @param [out] stats, the counters.
+     * @returns 0 is succeed; other is failed.
+     */
+    int32_t GetStats(SurfaceStats& stats) override;
+
     /**
      * @brief Serialize Surface attr to IpcIo.
      * @param [out], IpcIo.
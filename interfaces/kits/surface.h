@@ -313,6 +313,154 @@ public:
      */
     virtual void UnregisterConsumerListener() = 0;
 
+    /**
+     * @brief Sets whether the surface works in lock-free mode.
+     *
+     * In lock-free mode, requesting, flushing, acquiring, and releasing buffers do not take the surface lock unless
+     * the producer has to allocate a buffer or wait for one. This mode is available only when producers and
+     * consumers are in the same process, with only one thread requesting, flushing, and canceling buffers and only
+     * one thread acquiring and releasing buffers. Call this function before producers and consumers start. \n
+     *
+     * @param enable Specifies whether to enable lock-free mode. The default value is <b>false</b>.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual void SetLockFreeMode(bool enable) = 0;
+
+    /**
+     * @brief Sets whether the surface works in mailbox mode.
+     *
+     * In mailbox mode, the dirty queue holds only the latest frame. When a buffer is flushed while a previously
+     * flushed buffer has not been acquired, the previous buffer is dropped and returned to the free queue, so
+     * consumers always acquire the latest frame. This function is available only for consumers. \n
+     *
+     * @param enable Specifies whether to enable mailbox mode. The default value is <b>false</b>.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual void SetMailboxMode(bool enable) = 0;
+
+    /**
+     * @brief Enables the control ring shared with the consumer.
+     *
+     * With the control ring, the producer in another process requests free buffers and flushes buffers through
+     * shared memory, so a frame no longer waits for two IPC round trips. IPC messages are still sent to notify the
+     * consumer of flushed buffers, to wait for free buffers, and to map buffers that have not been requested before.
+     * Buffers with extra data are flushed through IPC. This function is available only for producers in a process
+     * other than the consumer's, and is unavailable in lock-free mode.
+     *
+     * @return Returns <b>0</b> if the operation is successful; returns an error code otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t EnableControlRing() = 0;
+
+    /**
+     * @brief Sets whether buffers are flushed asynchronously.
+     *
+     * In asynchronous flush mode, {@link FlushBuffer} sends a one-way IPC message and returns without waiting for
+     * the consumer. If the consumer fails to queue the buffer, the error is reported with the reply of the next
+     * {@link RequestBuffer} call that goes through IPC, and can be obtained by calling {@link GetAsyncFlushError}.
+     * This function is available only for producers in a process other than the consumer's.
+     *
+     * @param enable Specifies whether to enable asynchronous flush mode. The default value is <b>false</b>.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual void SetAsyncFlushMode(bool enable) = 0;
+
+    /**
+     * @brief Obtains and clears the error of the last failed asynchronous flush.
+     *
+     * @return Returns the error code of the last failed asynchronous flush; returns <b>0</b> if no asynchronous
+     * flush has failed since the last call.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t GetAsyncFlushError() = 0;
+
+    /**
+     * @brief Obtains the latencies of the buffer cycle of this surface.
+     *
+     * The buffer queue records the time of each request, flush, acquire, and release, and aggregates the
+     * latencies between them into histograms since the surface was created. This function is available only for
+     * consumers.
+     *
+     * @param stats Indicates the latencies obtained.
+     * @return Returns <b>0</b> if the operation is successful; returns an error code otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t GetLatencyStats(SurfaceLatencyStats& stats) = 0;
+
+    /**
+     * @brief Obtains the counters of the buffer queue of this surface.
+     *
+     * The counters are accumulated since the surface was created. A producer in another process obtains them
+     * from the consumer through IPC.
+     *
+     * @param stats Indicates the counters obtained.
+     * @return Returns <b>0</b> if the operation is successful; returns an error code otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t GetStats(SurfaceStats& stats) = 0;
+
+    /**
+     * @brief Allocates all buffers of the surface in advance.
+     *
+     * Buffers are allocated until their number reaches the queue size, so that subsequent {@link RequestBuffer}
+     * calls do not allocate memory. Call this function after the width, height, format, and queue size are set.
+     *
+     * @param async Specifies whether the buffers are allocated in a background thread. If <b>async</b> is
+     * <b>true</b>, the function returns immediately. The default value is <b>false</b>.
+     * @return Returns <b>0</b> if the operation is successful; returns an error code otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t Preallocate(bool async = false) = 0;
+
+    /**
+     * @brief Obtains a buffer to write data, waiting no longer than the specified timeout.
+     *
+     * This function behaves like {@link RequestBuffer(uint8_t wait)}, except that a waiting call returns
+     * <b>nullptr</b> once <b>timeout</b> expires without a buffer becoming available.
+     *
+     * @param wait Specifies whether the function waits for an available buffer. If <b>wait</b> is <b>1</b>,
+     * the function waits until there is an available buffer in the free queue or <b>timeout</b> expires.
+     * If the <b>wait</b> is <b>0</b>, the function does not wait and returns <b>nullptr</b> if there is no buffer
+     * in the free queue.
+     * @param timeout Indicates the longest time to wait, in nanoseconds, measured on a monotonic clock.
+     * A negative value means waiting without limit.
+     * @return Returns the pointer to the buffer if the operation is successful; returns <b>nullptr</b> otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual SurfaceBuffer* RequestBuffer(uint8_t wait, int64_t timeout) = 0;
+
+    /**
+     * @brief Sets the width, height, format, stride alignment, usage, size, and queue size of the surface at once.
+     *
+     * Buffers are reallocated only once for all changed attributes, and are kept if no attribute is changed.
+     * Across processes, all attributes are sent in one request. \n
+     *
+     * @param attributes Indicates the attributes to set. The <b>stride</b> field is ignored.
+     * @return Returns <b>0</b> if the operation is successful; returns an error code otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t SetAttributes(const SurfaceAttributes& attributes) = 0;
+
+    /**
+     * @brief Obtains all attributes of the surface at once.
+     *
+     * @param attributes Indicates the obtained attributes.
+     * @return Returns <b>0</b> if the operation is successful; returns an error code otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t GetAttributes(SurfaceAttributes& attributes) = 0;
+
 protected:
     Surface() {}
 };
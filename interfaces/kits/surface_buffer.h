@@ -41,6 +41,7 @@
 #define GRAPHIC_LITE_SURFACE_BUFFER_H
 
 #include <map>
+#include "surface_type.h"
 
 namespace OHOS {
 /**
@@ -146,6 +147,72 @@ public:
      */
     virtual int32_t GetInt64(uint32_t key, int64_t& value) = 0;
 
+    /**
+     * @brief Sets an extra attribute value of the blob type.
+     *
+     * Sets an extra attribute value of the blob type, such as per-frame metadata. The blob is copied into the buffer
+     * and carried with the buffer from producer to consumer. A blob is no longer than 256 bytes, and all blobs of
+     * a buffer are no longer than 512 bytes. If the same keys are used in two calls, \n
+     * the value in the second call overwrites that in the first call. \n
+     *
+     * @param key Indicates the key of a key-value pair to set.
+     * @param data Indicates the pointer to the blob to set.
+     * @param size Indicates the size of the blob to set.
+     * @return Returns <b>0</b> if the operation is successful; returns <b>-1</b> otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t SetBlob(uint32_t key, const void* data, uint32_t size) = 0;
+
+    /**
+     * @brief Obtains an extra attribute value of the blob type.
+     *
+     * Obtains an extra attribute value of the blob type, the blob is copied to <b>data</b>. If <b>data</b> is
+     * <b>nullptr</b>, only the size of the blob is obtained and <b>0</b> is returned.
+     * If the key does not exist, the value is not blob, or <b>size</b> is smaller than the blob, <b>-1</b> is returned.
+     *
+     * @param key Indicates the key of a key-value pair for which the value is to be obtained.
+     * @param data Indicates the pointer to the memory which the blob is copied to, or <b>nullptr</b> to query size.
+     * @param size Indicates the size of <b>data</b> as input, and the size of the blob as output.
+     * @return Returns <b>0</b> if the operation is successful; returns <b>-1</b> otherwise.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t GetBlob(uint32_t key, void* data, uint32_t& size) = 0;
+
+    /**
+     * @brief Sets the damage of the buffer, which is the area changed since the previous buffer flushed.
+     *
+     * Sets the rectangles that the producer changed, which are carried with the buffer from producer to consumer,
+     * so that the consumer composes and flushes caches only for the changed area. A buffer without damage is
+     * changed as a whole, which is the default of each requested buffer. If more than
+     * {@link SURFACE_MAX_DAMAGE_COUNT} rectangles are set, the last rectangle grows to cover the rest. \n
+     *
+     * @param rects Indicates the pointer to the damage rectangles to set.
+     * @param count Indicates the number of rectangles, <b>0</b> means the whole buffer is changed.
+     * @return Returns <b>0</b> if the operation is successful; returns <b>-1</b> if any rectangle is empty or out of
+     * the maximum surface size.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t SetDamage(const SurfaceDamageRect* rects, uint32_t count) = 0;
+
+    /**
+     * @brief Obtains the damage of the buffer.
+     *
+     * Obtains the rectangles that the producer changed, the consumer calls it after acquiring the buffer. If frames
+     * are dropped in mailbox mode, the damage of dropped frames is merged. If <b>count</b> is <b>0</b> as output,
+     * the whole buffer is changed.
+     *
+     * @param rects Indicates the pointer to the memory which the rectangles are copied to.
+     * @param count Indicates the number of rectangles <b>rects</b> holds as input, and the number of damage
+     * rectangles as output.
+     * @return Returns <b>0</b> if the operation is successful; returns <b>-1</b> if <b>rects</b> is too small.
+     * @since 1.0
+     * @version 1.0
+     */
+    virtual int32_t GetDamage(SurfaceDamageRect* rects, uint32_t& count) = 0;
+
 protected:
     SurfaceBuffer() {}
     virtual ~SurfaceBuffer() {}
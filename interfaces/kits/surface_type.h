@@ -49,6 +49,7 @@ constexpr uint16_t SURFACE_DEFAULT_QUEUE_SIZE = 1;
 constexpr uint16_t SURFACE_MAX_STRIDE_ALIGNMENT = 32;
 constexpr uint16_t SURFACE_MIN_STRIDE_ALIGNMENT = 4;
 constexpr uint16_t SURFACE_DEFAULT_STRIDE_ALIGNMENT = 4;
+constexpr uint16_t SURFACE_MAX_DAMAGE_COUNT = 16;
 #define SURFACE_MAX_SIZE 58982400 // 8K * 8K
 
 /**
@@ -68,5 +69,118 @@ enum BufferConsumerUsage {
      *  range. */
     BUFFER_CONSUMER_USAGE_MAX
 };
+
+/**
+ * @brief Defines the attributes of a surface, which are set or obtained in one call.
+ *
+ */
+struct SurfaceAttributes {
+    /** Buffer width, in pixels */
+    uint32_t width;
+    /** Buffer height, in pixels */
+    uint32_t height;
+    /** Pixel format. For details, see {@link ImagePixelFormat}. */
+    uint32_t format;
+    /** Stride alignment, in bytes */
+    uint32_t strideAlignment;
+    /** Usage scenario of the buffer. For details, see {@link BufferConsumerUsage}. */
+    uint32_t usage;
+    /** Buffer size, in bytes. <b>0</b> means the size is calculated from the width, height, and format. */
+    uint32_t size;
+    /** Stride of the buffer, in bytes. It is ignored when the attributes are set. */
+    uint32_t stride;
+    /** Number of buffers that can be allocated to the surface */
+    uint8_t queueSize;
+};
+
+/**
+ * @brief Defines a rectangle of a buffer that the producer changed, in pixels.
+ *
+ */
+struct SurfaceDamageRect {
+    /** Left edge of the rectangle */
+    uint32_t x;
+    /** Top edge of the rectangle */
+    uint32_t y;
+    /** Width of the rectangle */
+    uint32_t width;
+    /** Height of the rectangle */
+    uint32_t height;
+};
+
+/**
+ * @brief Number of buckets in a latency histogram. Bucket <b>i</b> counts latencies from 2^i to 2^(i+1)
+ * microseconds, bucket <b>0</b> also counts latencies under 1 microsecond, and the last bucket counts all
+ * longer latencies.
+ */
+constexpr uint8_t SURFACE_LATENCY_BUCKET_COUNT = 20;
+
+/**
+ * @brief Defines a latency histogram with power-of-two buckets, in microseconds.
+ *
+ */
+struct SurfaceLatencyHistogram {
+    /** Number of recorded latencies */
+    uint32_t count;
+    /** Number of recorded latencies in each bucket */
+    uint32_t buckets[SURFACE_LATENCY_BUCKET_COUNT];
+    /** Sum of recorded latencies, in microseconds */
+    uint64_t totalUs;
+    /** Maximum recorded latency, in microseconds */
+    uint64_t maxUs;
+};
+
+/**
+ * @brief Defines the latencies of the buffer cycle of a surface.
+ *
+ */
+struct SurfaceLatencyStats {
+    /** Time from request to flush of a buffer, which is held by the producer */
+    SurfaceLatencyHistogram producerHold;
+    /** Time from flush to acquire of a buffer, which waits in the queue */
+    SurfaceLatencyHistogram queueDwell;
+    /** Time from acquire to release of a buffer, which is held by the consumer */
+    SurfaceLatencyHistogram consumerHold;
+    /** Time a request waits for a free buffer or allocates a buffer */
+    SurfaceLatencyHistogram requestWait;
+};
+
+/**
+ * @brief Defines the counters of the buffer queue of a surface, which tell whether the surface is bound by the
+ * producer or the consumer.
+ *
+ */
+struct SurfaceStats {
+    /** Total time that requests are blocked waiting for a free buffer, in microseconds */
+    uint64_t waitUs;
+    /** Number of buffer requests */
+    uint32_t requests;
+    /** Number of successful buffer requests */
+    uint32_t requestSucceeded;
+    /** Number of failed buffer requests, including requests that time out or do not wait */
+    uint32_t requestFailed;
+    /** Number of times requests are blocked waiting for a free buffer */
+    uint32_t waits;
+    /** Number of flushed buffers */
+    uint32_t flushes;
+    /** Number of acquire calls */
+    uint32_t acquires;
+    /** Number of acquire calls that find no flushed buffer */
+    uint32_t emptyAcquires;
+    /** Number of buffers allocated */
+    uint32_t allocs;
+    /** Number of buffers freed */
+    uint32_t frees;
+    /** Number of buffers freed when they come back after the attributes changed */
+    uint32_t deletePendingDetaches;
+    /** Maximum number of free buffers waiting for requests */
+    uint32_t peakFreeDepth;
+    /** Maximum number of flushed buffers waiting for acquires */
+    uint32_t peakDirtyDepth;
+    /** Number of times the queue lock is held by another thread when it is taken */
+    uint32_t lockContentions;
+    /** Total time spent waiting for the queue lock held by another thread, in microseconds */
+    uint64_t lockWaitUs;
+};
 } // end namespace OHOS
 #endif
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark of the surface buffer cycle, request, flush, acquire and release. Every case runs the cycle in
+ * batches of queue size buffers, and reports cycles per second and latency percentiles of each operation as JSON.
+ *
+ * Usage: lite_surface_benchmark [-n cycles] [-s surfaces] [-o file] [-q]
+ *     -n  cycles of each case, default 2000
+ *     -s  max number of concurrent surfaces, default 4
+ *     -o  write JSON to file instead of stdout
+ *     -q  quick run, only a few cases of each group
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "surface.h"
+#include "surface_impl.h"
+
+namespace OHOS {
+namespace {
+const uint32_t DEFAULT_CYCLES = 2000;
+const uint32_t DEFAULT_SURFACES = 4;
+const uint32_t WARMUP_ROUNDS = 2;
+const uint32_t IPC_DATA_SIZE = 256;
+const int64_t NSEC_PER_SEC = 1000000000;
+const uint32_t PERCENT = 100;
+const uint32_t PERMILLE = 1000;
+
+enum BenchOp {
+    OP_REQUEST = 0,
+    OP_FLUSH,
+    OP_ACQUIRE,
+    OP_RELEASE,
+    OP_COUNT
+};
+
+const char* const OP_NAMES[OP_COUNT] = { "request", "flush", "acquire", "release" };
+
+struct BenchSize {
+    const char* name;
+    uint32_t width;
+    uint32_t height;
+};
+
+const BenchSize SIZE_QVGA = { "QVGA", 320, 240 };
+const BenchSize SIZE_VGA = { "VGA", 640, 480 };
+const BenchSize SIZE_720P = { "720p", 1280, 720 };
+const BenchSize SIZE_1080P = { "1080p", 1920, 1080 };
+const BenchSize SIZE_4K = { "4K", 3840, 2160 };
+const BenchSize SIZE_8K = { "8K", 7680, 4320 };
+
+struct BenchFormat {
+    const char* name;
+    uint32_t format;
+};
+
+const BenchFormat FORMAT_RGB565 = { "RGB565", IMAGE_PIXEL_FORMAT_RGB565 };
+const BenchFormat FORMAT_ARGB8888 = { "ARGB8888", IMAGE_PIXEL_FORMAT_ARGB8888 };
+const BenchFormat FORMAT_NV12 = { "NV12", IMAGE_PIXEL_FORMAT_NV12 };
+
+struct BenchUsage {
+    const char* name;
+    uint32_t usage;
+};
+
+const BenchUsage USAGE_SOFTWARE = { "software", BUFFER_CONSUMER_USAGE_SORTWARE };
+const BenchUsage USAGE_HARDWARE = { "hardware", BUFFER_CONSUMER_USAGE_HARDWARE };
+const BenchUsage USAGE_CONSUMER_CACHE = { "hardware_consumer_cache", BUFFER_CONSUMER_USAGE_HARDWARE_CONSUMER_CACHE };
+const BenchUsage USAGE_PRODUCER_CACHE = { "hardware_producer_cache", BUFFER_CONSUMER_USAGE_HARDWARE_PRODUCER_CACHE };
+
+struct BenchCase {
+    std::string group;
+    BenchSize size;
+    BenchFormat format;
+    BenchUsage usage;
+    uint8_t queueSize;
+    bool ipc;
+    uint32_t surfaces;
+};
+
+struct BenchOptions {
+    uint32_t cycles = DEFAULT_CYCLES;
+    uint32_t surfaces = DEFAULT_SURFACES;
+    const char* output = nullptr;
+    bool quick = false;
+};
+
+struct BenchSamples {
+    std::vector<uint32_t> latency[OP_COUNT];
+    uint64_t cycles = 0;
+};
+
+struct BenchResult {
+    BenchCase benchCase;
+    double seconds = 0;
+    BenchSamples samples;
+    std::string error;
+};
+
+struct BenchThread {
+    const BenchCase* benchCase;
+    uint32_t cycles;
+    pthread_barrier_t* barrier;
+    int64_t start = 0;
+    int64_t end = 0;
+    BenchSamples samples;
+    std::string error;
+};
+
+int64_t NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+Surface* CreateProducer(Surface* consumer)
+{
+    IpcIo io;
+    uint8_t data[IPC_DATA_SIZE];
+    IpcIoInit(&io, data, IPC_DATA_SIZE, 1);
+    static_cast<SurfaceImpl*>(consumer)->WriteIoIpcIo(io);
+    IpcIo reader;
+    IpcIoInit(&reader, data, IPC_DATA_SIZE, 1);
+    return SurfaceImpl::GenericSurfaceByIpcIo(reader);
+}
+
+/* Runs rounds of queue size cycles, batched so that every slot of the queue is used in each round. */
+bool RunRounds(Surface* producer, Surface* consumer, uint8_t queueSize, uint32_t rounds, BenchSamples* samples)
+{
+    std::vector<SurfaceBuffer*> buffers(queueSize, nullptr);
+    for (uint32_t round = 0; round < rounds; round++) {
+        int64_t start = NowNs();
+        for (uint8_t i = 0; i < queueSize; i++) {
+            buffers[i] = producer->RequestBuffer();
+            int64_t end = NowNs();
+            if (buffers[i] == nullptr) {
+                return false;
+            }
+            if (samples != nullptr) {
+                samples->latency[OP_REQUEST].push_back(static_cast<uint32_t>(end - start));
+            }
+            start = end;
+        }
+        for (uint8_t i = 0; i < queueSize; i++) {
+            int32_t ret = producer->FlushBuffer(buffers[i]);
+            int64_t end = NowNs();
+            if (ret != 0) {
+                return false;
+            }
+            if (samples != nullptr) {
+                samples->latency[OP_FLUSH].push_back(static_cast<uint32_t>(end - start));
+            }
+            start = end;
+        }
+        for (uint8_t i = 0; i < queueSize; i++) {
+            buffers[i] = consumer->AcquireBuffer();
+            int64_t end = NowNs();
+            if (buffers[i] == nullptr) {
+                return false;
+            }
+            if (samples != nullptr) {
+                samples->latency[OP_ACQUIRE].push_back(static_cast<uint32_t>(end - start));
+            }
+            start = end;
+        }
+        for (uint8_t i = 0; i < queueSize; i++) {
+            bool released = consumer->ReleaseBuffer(buffers[i]);
+            int64_t end = NowNs();
+            if (!released) {
+                return false;
+            }
+            if (samples != nullptr) {
+                samples->latency[OP_RELEASE].push_back(static_cast<uint32_t>(end - start));
+            }
+            start = end;
+        }
+        if (samples != nullptr) {
+            samples->cycles += queueSize;
+        }
+    }
+    return true;
+}
+
+void* RunSurface(void* arg)
+{
+    BenchThread* thread = static_cast<BenchThread*>(arg);
+    const BenchCase& benchCase = *thread->benchCase;
+    Surface* consumer = Surface::CreateSurface();
+    Surface* producer = nullptr;
+    if (consumer != nullptr) {
+        consumer->SetWidthAndHeight(benchCase.size.width, benchCase.size.height);
+        consumer->SetFormat(benchCase.format.format);
+        consumer->SetUsage(benchCase.usage.usage);
+        consumer->SetQueueSize(benchCase.queueSize);
+        producer = benchCase.ipc ? CreateProducer(consumer) : consumer;
+    }
+    uint32_t rounds = std::max(thread->cycles / benchCase.queueSize, 1U);
+    for (uint32_t op = 0; op < OP_COUNT; op++) {
+        thread->samples.latency[op].reserve(rounds * benchCase.queueSize);
+    }
+    /* Warm up allocates and maps all buffers, so the measured rounds only cycle them. */
+    if (producer == nullptr) {
+        thread->error = "create surface failed";
+    } else if (!RunRounds(producer, consumer, benchCase.queueSize, WARMUP_ROUNDS, nullptr)) {
+        thread->error = "warm up failed";
+    }
+    pthread_barrier_wait(thread->barrier);
+    thread->start = NowNs();
+    if (thread->error.empty() &&
+        !RunRounds(producer, consumer, benchCase.queueSize, rounds, &thread->samples)) {
+        thread->error = "buffer cycle failed";
+    }
+    thread->end = NowNs();
+    if (producer != consumer) {
+        delete producer;
+    }
+    delete consumer;
+    return nullptr;
+}
+
+BenchResult RunCase(const BenchCase& benchCase, uint32_t cycles)
+{
+    BenchResult result;
+    result.benchCase = benchCase;
+    std::vector<BenchThread> threads(benchCase.surfaces);
+    std::vector<pthread_t> tids(benchCase.surfaces);
+    pthread_barrier_t barrier;
+    /* All surfaces are warm before any of them starts measuring. */
+    pthread_barrier_init(&barrier, nullptr, benchCase.surfaces);
+    uint32_t started = 0;
+    for (; started < benchCase.surfaces; started++) {
+        threads[started].benchCase = &benchCase;
+        threads[started].cycles = cycles;
+        threads[started].barrier = &barrier;
+        if (pthread_create(&tids[started], nullptr, RunSurface, &threads[started]) != 0) {
+            break;
+        }
+    }
+    if (started != benchCase.surfaces) {
+        /* Never reached by all parties, the started threads would block on the barrier forever. */
+        fprintf(stderr, "create benchmark thread failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < benchCase.surfaces; i++) {
+        pthread_join(tids[i], nullptr);
+    }
+    pthread_barrier_destroy(&barrier);
+
+    int64_t start = threads[0].start;
+    int64_t end = threads[0].end;
+    for (uint32_t i = 0; i < benchCase.surfaces; i++) {
+        start = std::min(start, threads[i].start);
+        end = std::max(end, threads[i].end);
+        if (!threads[i].error.empty() && result.error.empty()) {
+            result.error = threads[i].error;
+        }
+        result.samples.cycles += threads[i].samples.cycles;
+        for (uint32_t op = 0; op < OP_COUNT; op++) {
+            std::vector<uint32_t>& to = result.samples.latency[op];
+            const std::vector<uint32_t>& from = threads[i].samples.latency[op];
+            to.insert(to.end(), from.begin(), from.end());
+        }
+    }
+    result.seconds = static_cast<double>(end - start) / NSEC_PER_SEC;
+    return result;
+}
+
+uint32_t Percentile(const std::vector<uint32_t>& sorted, uint32_t numerator, uint32_t denominator)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>((static_cast<uint64_t>(sorted.size()) - 1) * numerator / denominator);
+    return sorted[index];
+}
+
+void WriteResult(FILE* out, const BenchResult& result, bool last)
+{
+    const BenchCase& benchCase = result.benchCase;
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"group\": \"%s\",\n", benchCase.group.c_str());
+    fprintf(out, "      \"producer\": \"%s\",\n", benchCase.ipc ? "ipc" : "local");
+    fprintf(out, "      \"size\": \"%s\",\n", benchCase.size.name);
+    fprintf(out, "      \"width\": %u,\n", benchCase.size.width);
+    fprintf(out, "      \"height\": %u,\n", benchCase.size.height);
+    fprintf(out, "      \"format\": \"%s\",\n", benchCase.format.name);
+    fprintf(out, "      \"usage\": \"%s\",\n", benchCase.usage.name);
+    fprintf(out, "      \"queueSize\": %u,\n", benchCase.queueSize);
+    fprintf(out, "      \"surfaces\": %u,\n", benchCase.surfaces);
+    if (!result.error.empty()) {
+        fprintf(out, "      \"error\": \"%s\"\n", result.error.c_str());
+        fprintf(out, "    }%s\n", last ? "" : ",");
+        return;
+    }
+    double cyclesPerSecond = (result.seconds > 0) ? result.samples.cycles / result.seconds : 0;
+    fprintf(out, "      \"cycles\": %llu,\n", static_cast<unsigned long long>(result.samples.cycles));
+    fprintf(out, "      \"seconds\": %.6f,\n", result.seconds);
+    fprintf(out, "      \"cyclesPerSecond\": %.1f,\n", cyclesPerSecond);
+    fprintf(out, "      \"latencyNs\": {\n");
+    for (uint32_t op = 0; op < OP_COUNT; op++) {
+        std::vector<uint32_t> sorted = result.samples.latency[op];
+        std::sort(sorted.begin(), sorted.end());
+        uint64_t sum = 0;
+        for (uint32_t value : sorted) {
+            sum += value;
+        }
+        uint64_t mean = sorted.empty() ? 0 : sum / sorted.size();
+        fprintf(out, "        \"%s\": { \"mean\": %llu, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"p999\": %u, "
+            "\"max\": %u }%s\n", OP_NAMES[op], static_cast<unsigned long long>(mean),
+            Percentile(sorted, 50, PERCENT), Percentile(sorted, 90, PERCENT), // 50, 90 : percentiles
+            Percentile(sorted, 99, PERCENT), Percentile(sorted, 999, PERMILLE), // 99, 999 : percentiles
+            sorted.empty() ? 0 : sorted.back(), (op + 1 == OP_COUNT) ? "" : ",");
+    }
+    fprintf(out, "      }\n");
+    fprintf(out, "    }%s\n", last ? "" : ",");
+}
+
+void AddQueueSizeCases(const BenchOptions& options, std::vector<BenchCase>& cases)
+{
+    const uint8_t quickSizes[] = { 1, 3, 10 };
+    const uint8_t fullSizes[] = { 1, 2, 3, 4, 6, 8, 10 };
+    const uint8_t* sizes = options.quick ? quickSizes : fullSizes;
+    size_t count = options.quick ? sizeof(quickSizes) : sizeof(fullSizes);
+    for (size_t i = 0; i < count; i++) {
+        for (bool ipc : { false, true }) {
+            cases.push_back({ "queue_size", SIZE_VGA, FORMAT_RGB565, USAGE_SOFTWARE, sizes[i], ipc, 1 });
+        }
+    }
+}
+
+void AddBufferSizeCases(const BenchOptions& options, std::vector<BenchCase>& cases)
+{
+    const BenchSize fullSizes[] = { SIZE_QVGA, SIZE_VGA, SIZE_720P, SIZE_1080P, SIZE_4K, SIZE_8K };
+    const BenchSize quickSizes[] = { SIZE_QVGA, SIZE_1080P, SIZE_8K };
+    const BenchFormat formats[] = { FORMAT_RGB565, FORMAT_ARGB8888, FORMAT_NV12 };
+    const BenchSize* sizes = options.quick ? quickSizes : fullSizes;
+    size_t count = options.quick ? sizeof(quickSizes) / sizeof(BenchSize) : sizeof(fullSizes) / sizeof(BenchSize);
+    for (size_t i = 0; i < count; i++) {
+        for (const BenchFormat& format : formats) {
+            /* Cases the allocator could not serve, like 8K RGB on most devices, are reported with an error. */
+            cases.push_back({ "buffer_size", sizes[i], format, USAGE_SOFTWARE, 3, false, 1 }); // 3 : queue size
+        }
+    }
+}
+
+void AddUsageCases(const BenchOptions& options, std::vector<BenchCase>& cases)
+{
+    const BenchUsage usages[] = { USAGE_SOFTWARE, USAGE_HARDWARE, USAGE_CONSUMER_CACHE, USAGE_PRODUCER_CACHE };
+    for (const BenchUsage& usage : usages) {
+        for (bool ipc : { false, true }) {
+            cases.push_back({ "usage", SIZE_1080P, FORMAT_ARGB8888, usage, 3, ipc, 1 }); // 3 : queue size
+        }
+        if (options.quick) {
+            break;
+        }
+    }
+}
+
+void AddConcurrencyCases(const BenchOptions& options, std::vector<BenchCase>& cases)
+{
+    /* Double the surfaces each case, and always end with the requested maximum. */
+    uint32_t surfaces = 1;
+    while (true) {
+        for (bool ipc : { false, true }) {
+            cases.push_back({ "surfaces", SIZE_VGA, FORMAT_RGB565, USAGE_SOFTWARE, 3, ipc, surfaces }); // 3 : queue
+        }
+        if (surfaces == options.surfaces) {
+            break;
+        }
+        surfaces = std::min(surfaces * 2, options.surfaces); // 2 : double surfaces each case
+    }
+}
+
+bool ParseOptions(int argc, char* argv[], BenchOptions& options)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:o:q")) != -1) {
+        switch (opt) {
+            case 'n':
+                options.cycles = static_cast<uint32_t>(strtoul(optarg, nullptr, 0));
+                break;
+            case 's':
+                options.surfaces = static_cast<uint32_t>(strtoul(optarg, nullptr, 0));
+                break;
+            case 'o':
+                options.output = optarg;
+                break;
+            case 'q':
+                options.quick = true;
+                break;
+            default:
+                return false;
+        }
+    }
+    return options.cycles != 0 && options.surfaces != 0;
+}
+} // namespace
+} // namespace OHOS
+
+using namespace OHOS;
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "Usage: %s [-n cycles] [-s surfaces] [-o file] [-q]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::vector<BenchCase> cases;
+    AddQueueSizeCases(options, cases);
+    AddBufferSizeCases(options, cases);
+    AddUsageCases(options, cases);
+    AddConcurrencyCases(options, cases);
+
+    FILE* out = stdout;
+    if (options.output != nullptr) {
+        out = fopen(options.output, "w");
+        if (out == nullptr) {
+            fprintf(stderr, "Open %s failed\n", options.output);
+            return EXIT_FAILURE;
+        }
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"lite_surface_benchmark\",\n");
+    fprintf(out, "  \"cyclesPerCase\": %u,\n", options.cycles);
+    fprintf(out, "  \"results\": [\n");
+    int failed = 0;
+    for (size_t i = 0; i < cases.size(); i++) {
+        BenchResult result = RunCase(cases[i], options.cycles);
+        if (!result.error.empty()) {
+            failed++;
+        }
+        WriteResult(out, result, i + 1 == cases.size());
+        fflush(out);
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"failedCases\": %d\n", failed);
+    fprintf(out, "}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+    return EXIT_SUCCESS;
+}
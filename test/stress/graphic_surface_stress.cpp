@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2022 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stress test of buffer queue. Every workload runs producer, consumer and reconfiguration threads on one queue
+ * at full speed for a set duration, while a checker thread verifies the queue bookkeeping. At the end all
+ * buffers are returned and the queue must hand out exactly queue size buffers again, so no buffer is lost or
+ * attached twice. Throughput and lock contention are reported as JSON, and the exit code is non zero if any
+ * check fails. Build the queue and this test with -fsanitize=thread to look for data races.
+ *
+ * Usage: lite_surface_stress [-t seconds] [-p producers] [-w workload] [-o file]
+ *     -t  seconds of each workload, default 5
+ *     -p  producer threads of locked workloads, default 3
+ *     -w  run only one workload, locked, mailbox or lock_free
+ *     -o  write JSON to file instead of stdout
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "buffer_manager.h"
+#include "buffer_queue.h"
+
+namespace OHOS {
+namespace {
+const uint32_t DEFAULT_SECONDS = 5;
+const uint32_t DEFAULT_PRODUCERS = 3;
+const int64_t NSEC_PER_SEC = 1000000000;
+const int64_t NSEC_PER_MSEC = 1000000;
+const int64_t REQUEST_TIMEOUT_NS = 10 * NSEC_PER_MSEC;
+const uint32_t RECONFIG_INTERVAL_US = 500;
+const uint32_t CHECK_INTERVAL_US = 200;
+const uint32_t CANCEL_RATIO = 8;
+const uint8_t MAX_QUEUE_SIZE = 10;
+const uint32_t SMALL_WIDTH = 64;
+const uint32_t SMALL_HEIGHT = 48;
+const uint32_t LARGE_WIDTH = 128;
+const uint32_t LARGE_HEIGHT = 96;
+
+struct StressWorkload {
+    const char* name;
+    bool mailbox;
+    bool lockFree;
+};
+
+const StressWorkload WORKLOADS[] = {
+    { "locked", false, false },
+    { "mailbox", true, false },
+    /* The lock free rings are single producer and single consumer, the queue is checked when it is idle. */
+    { "lock_free", false, true },
+};
+
+struct StressOptions {
+    uint32_t seconds = DEFAULT_SECONDS;
+    uint32_t producers = DEFAULT_PRODUCERS;
+    const char* workload = nullptr;
+    const char* output = nullptr;
+};
+
+struct StressCounters {
+    std::atomic<uint64_t> requests { 0 };
+    std::atomic<uint64_t> requestTimeouts { 0 };
+    std::atomic<uint64_t> flushes { 0 };
+    std::atomic<uint64_t> cancels { 0 };
+    std::atomic<uint64_t> acquires { 0 };
+    std::atomic<uint64_t> releases { 0 };
+    std::atomic<uint64_t> reconfigs { 0 };
+    std::atomic<uint64_t> checks { 0 };
+    std::atomic<uint64_t> errors { 0 };
+};
+
+struct StressContext {
+    BufferQueue* queue;
+    const StressWorkload* workload;
+    std::atomic<bool> stop { false };
+    StressCounters counters;
+    std::string error;
+    pthread_mutex_t errorLock = PTHREAD_MUTEX_INITIALIZER;
+};
+
+struct StressResult {
+    const StressWorkload* workload;
+    uint32_t producers = 0;
+    double seconds = 0;
+    uint8_t queueSize = 0;
+    uint8_t returnedBuffers = 0;
+    SurfaceStats stats {};
+    std::string error;
+};
+
+int64_t NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void Fail(StressContext* context, const char* error)
+{
+    context->counters.errors++;
+    pthread_mutex_lock(&context->errorLock);
+    if (context->error.empty()) {
+        context->error = error;
+    }
+    pthread_mutex_unlock(&context->errorLock);
+}
+
+void* RunProducer(void* arg)
+{
+    StressContext* context = static_cast<StressContext*>(arg);
+    StressCounters& counters = context->counters;
+    unsigned int seed = static_cast<unsigned int>(NowNs());
+    while (!context->stop.load()) {
+        SurfaceBufferImpl* buffer = context->queue->RequestBuffer(1, REQUEST_TIMEOUT_NS);
+        if (buffer == nullptr) {
+            counters.requestTimeouts++;
+            continue;
+        }
+        counters.requests++;
+        uint8_t* virAddr = static_cast<uint8_t*>(buffer->GetVirAddr());
+        if (virAddr != nullptr && buffer->GetSize() != 0) {
+            virAddr[0]++;
+        }
+        if (rand_r(&seed) % CANCEL_RATIO == 0) {
+            if (context->queue->CancelBuffer(*buffer) != SURFACE_ERROR_OK) {
+                Fail(context, "cancel buffer failed");
+            }
+            counters.cancels++;
+        } else {
+            if (context->queue->FlushBuffer(*buffer) != SURFACE_ERROR_OK) {
+                Fail(context, "flush buffer failed");
+            }
+            counters.flushes++;
+        }
+    }
+    return nullptr;
+}
+
+void* RunConsumer(void* arg)
+{
+    StressContext* context = static_cast<StressContext*>(arg);
+    StressCounters& counters = context->counters;
+    while (!context->stop.load()) {
+        SurfaceBufferImpl* buffer = context->queue->AcquireBuffer();
+        if (buffer == nullptr) {
+            sched_yield();
+            continue;
+        }
+        counters.acquires++;
+        if (!context->queue->ReleaseBuffer(*buffer)) {
+            Fail(context, "release buffer failed");
+        }
+        counters.releases++;
+    }
+    return nullptr;
+}
+
+/* Shrinks and grows the queue, and changes the buffer size, while buffers are in flight. */
+void* RunReconfig(void* arg)
+{
+    StressContext* context = static_cast<StressContext*>(arg);
+    unsigned int seed = static_cast<unsigned int>(NowNs());
+    bool large = false;
+    while (!context->stop.load()) {
+        if (rand_r(&seed) % 2 == 0) { // 2 : reconfigure queue size or buffer size at equal chance
+            context->queue->SetQueueSize(static_cast<uint8_t>(rand_r(&seed) % MAX_QUEUE_SIZE + 1));
+        } else {
+            large = !large;
+            context->queue->SetWidthAndHeight(large ? LARGE_WIDTH : SMALL_WIDTH, large ? LARGE_HEIGHT : SMALL_HEIGHT);
+        }
+        context->counters.reconfigs++;
+        usleep(RECONFIG_INTERVAL_US);
+    }
+    return nullptr;
+}
+
+void* RunChecker(void* arg)
+{
+    StressContext* context = static_cast<StressContext*>(arg);
+    while (!context->stop.load()) {
+        if (context->queue->CheckInvariants() != SURFACE_ERROR_OK) {
+            Fail(context, "queue invariants broken while running");
+        }
+        context->counters.checks++;
+        usleep(CHECK_INTERVAL_US);
+    }
+    return nullptr;
+}
+
+/* All threads are stopped, returns the dirty buffers and checks that the queue hands out all its buffers. */
+void CheckIdleQueue(StressContext& context, StressResult& result)
+{
+    BufferQueue* queue = context.queue;
+    SurfaceBufferImpl* buffer = nullptr;
+    while ((buffer = queue->AcquireBuffer()) != nullptr) {
+        queue->ReleaseBuffer(*buffer);
+    }
+    if (queue->CheckInvariants() != SURFACE_ERROR_OK) {
+        Fail(&context, "queue invariants broken when idle");
+        return;
+    }
+    result.queueSize = queue->GetQueueSize();
+    std::vector<SurfaceBufferImpl*> buffers;
+    while (buffers.size() <= BUFFER_QUEUE_SLOT_COUNT && (buffer = queue->RequestBuffer(0)) != nullptr) {
+        buffers.push_back(buffer);
+    }
+    result.returnedBuffers = static_cast<uint8_t>(buffers.size());
+    for (SurfaceBufferImpl* requested : buffers) {
+        queue->CancelBuffer(*requested);
+    }
+    SurfaceStats stats {};
+    queue->GetStats(stats);
+    if (result.returnedBuffers != result.queueSize) {
+        Fail(&context, "buffers are lost or attached over queue size");
+    } else if (stats.allocs - stats.frees != result.returnedBuffers) {
+        Fail(&context, "buffers are leaked by the queue");
+    } else if (queue->CheckInvariants() != SURFACE_ERROR_OK) {
+        Fail(&context, "queue invariants broken after requesting all buffers");
+    }
+}
+
+StressResult RunWorkload(const StressWorkload& workload, const StressOptions& options)
+{
+    StressResult result;
+    result.workload = &workload;
+    result.producers = workload.lockFree ? 1 : options.producers;
+    StressContext context;
+    context.workload = &workload;
+    context.queue = new BufferQueue();
+    if (context.queue == nullptr || !context.queue->Init()) {
+        result.error = "init buffer queue failed";
+        delete context.queue;
+        return result;
+    }
+    context.queue->SetWidthAndHeight(SMALL_WIDTH, SMALL_HEIGHT);
+    context.queue->SetQueueSize(MAX_QUEUE_SIZE / 2); // 2 : start from the middle of the range
+    context.queue->SetMailboxMode(workload.mailbox);
+    context.queue->SetLockFreeMode(workload.lockFree);
+
+    std::vector<pthread_t> tids;
+    std::vector<void* (*)(void*)> routines(result.producers, RunProducer);
+    routines.push_back(RunConsumer);
+    routines.push_back(RunReconfig);
+    if (!workload.lockFree) {
+        routines.push_back(RunChecker);
+    }
+    int64_t start = NowNs();
+    for (void* (*routine)(void*) : routines) {
+        pthread_t tid;
+        if (pthread_create(&tid, nullptr, routine, &context) != 0) {
+            Fail(&context, "create stress thread failed");
+            break;
+        }
+        tids.push_back(tid);
+    }
+    int64_t end = start + static_cast<int64_t>(options.seconds) * NSEC_PER_SEC;
+    while (tids.size() == routines.size() && context.counters.errors.load() == 0 && NowNs() < end) {
+        usleep(CHECK_INTERVAL_US);
+    }
+    context.stop.store(true);
+    for (pthread_t tid : tids) {
+        pthread_join(tid, nullptr);
+    }
+    result.seconds = static_cast<double>(NowNs() - start) / NSEC_PER_SEC;
+    if (context.counters.errors.load() == 0) {
+        CheckIdleQueue(context, result);
+    }
+    context.queue->GetStats(result.stats);
+    result.error = context.error;
+
+    StressCounters& counters = context.counters;
+    fprintf(stderr, "%s: %llu cycles, %llu reconfigs, %llu checks%s%s\n", workload.name,
+        static_cast<unsigned long long>(counters.releases.load()),
+        static_cast<unsigned long long>(counters.reconfigs.load()),
+        static_cast<unsigned long long>(counters.checks.load()),
+        result.error.empty() ? "" : ", ", result.error.c_str());
+    delete context.queue;
+    return result;
+}
+
+void WriteResult(FILE* out, const StressResult& result, bool last)
+{
+    const SurfaceStats& stats = result.stats;
+    double seconds = (result.seconds > 0) ? result.seconds : 1;
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"workload\": \"%s\",\n", result.workload->name);
+    fprintf(out, "      \"producers\": %u,\n", result.producers);
+    fprintf(out, "      \"seconds\": %.3f,\n", result.seconds);
+    fprintf(out, "      \"requests\": %u,\n", stats.requestSucceeded);
+    fprintf(out, "      \"flushes\": %u,\n", stats.flushes);
+    fprintf(out, "      \"acquires\": %u,\n", stats.acquires);
+    fprintf(out, "      \"cyclesPerSecond\": %.1f,\n", stats.acquires / seconds);
+    fprintf(out, "      \"allocs\": %u,\n", stats.allocs);
+    fprintf(out, "      \"frees\": %u,\n", stats.frees);
+    fprintf(out, "      \"waits\": %u,\n", stats.waits);
+    fprintf(out, "      \"waitUs\": %llu,\n", static_cast<unsigned long long>(stats.waitUs));
+    fprintf(out, "      \"lockContentions\": %u,\n", stats.lockContentions);
+    fprintf(out, "      \"lockWaitUs\": %llu,\n", static_cast<unsigned long long>(stats.lockWaitUs));
+    fprintf(out, "      \"queueSize\": %u,\n", result.queueSize);
+    fprintf(out, "      \"returnedBuffers\": %u,\n", result.returnedBuffers);
+    fprintf(out, "      \"passed\": %s%s\n", result.error.empty() ? "true" : "false", result.error.empty() ? "" : ",");
+    if (!result.error.empty()) {
+        fprintf(out, "      \"error\": \"%s\"\n", result.error.c_str());
+    }
+    fprintf(out, "    }%s\n", last ? "" : ",");
+}
+
+bool ParseOptions(int argc, char* argv[], StressOptions& options)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p:w:o:")) != -1) {
+        switch (opt) {
+            case 't':
+                options.seconds = static_cast<uint32_t>(strtoul(optarg, nullptr, 0));
+                break;
+            case 'p':
+                options.producers = static_cast<uint32_t>(strtoul(optarg, nullptr, 0));
+                break;
+            case 'w':
+                options.workload = optarg;
+                break;
+            case 'o':
+                options.output = optarg;
+                break;
+            default:
+                return false;
+        }
+    }
+    return options.seconds != 0 && options.producers != 0;
+}
+} // namespace
+} // namespace OHOS
+
+using namespace OHOS;
+
+int main(int argc, char* argv[])
+{
+    StressOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        fprintf(stderr, "Usage: %s [-t seconds] [-p producers] [-w workload] [-o file]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::vector<const StressWorkload*> workloads;
+    for (const StressWorkload& workload : WORKLOADS) {
+        if (options.workload == nullptr || strcmp(options.workload, workload.name) == 0) {
+            workloads.push_back(&workload);
+        }
+    }
+    if (workloads.empty()) {
+        fprintf(stderr, "Unknown workload %s\n", options.workload);
+        return EXIT_FAILURE;
+    }
+    if (!BufferManager::GetInstance()->Init()) {
+        fprintf(stderr, "Init buffer manager failed\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = stdout;
+    if (options.output != nullptr) {
+        out = fopen(options.output, "w");
+        if (out == nullptr) {
+            fprintf(stderr, "Open %s failed\n", options.output);
+            return EXIT_FAILURE;
+        }
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"stress\": \"lite_surface_stress\",\n");
+    fprintf(out, "  \"secondsPerWorkload\": %u,\n", options.seconds);
+    fprintf(out, "  \"results\": [\n");
+    int failed = 0;
+    for (size_t i = 0; i < workloads.size(); i++) {
+        StressResult result = RunWorkload(*workloads[i], options);
+        if (!result.error.empty()) {
+            failed++;
+        }
+        WriteResult(out, result, i + 1 == workloads.size());
+        fflush(out);
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"failedWorkloads\": %d\n", failed);
+    fprintf(out, "}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
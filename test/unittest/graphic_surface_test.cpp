@@ -15,8 +15,13 @@
 
 #include <climits>
 #include <gtest/gtest.h>
+#include <sys/shm.h>
 
 #include "buffer_common.h"
+#include "buffer_manager.h"
+#include "buffer_queue.h"
+#include "securec.h"
+#include "soft_gralloc.h"
 #include "surface.h"
 #include "surface_impl.h"
 
@@ -41,6 +46,29 @@ void BufferConsumerTest::OnBufferAvailable()
 {
 }
 
+/* Opens the consumer surface through ipc, as a producer of another process would. */
+static Surface* CreateIpcProducer(Surface* consumer)
+{
+    const uint32_t ipcDataSize = 256; // 256 : enough for the surface svc
+    uint8_t data[ipcDataSize];
+    IpcIo io;
+    IpcIoInit(&io, data, ipcDataSize, 1);
+    static_cast<SurfaceImpl*>(consumer)->WriteIoIpcIo(io);
+    IpcIo reader;
+    IpcIoInit(&reader, data, ipcDataSize, 1);
+    return SurfaceImpl::GenericSurfaceByIpcIo(reader);
+}
+
+/* Software gralloc buffer key is the shared memory id, a removed segment is gone after its last detach. */
+static int32_t GetAttachCount(int32_t key)
+{
+    struct shmid_ds ds;
+    if (shmctl(key, IPC_STAT, &ds) != 0) {
+        return 0;
+    }
+    return static_cast<int32_t>(ds.shm_nattch);
+}
+
 void SurfaceTest::SetUpTestCase(void)
 {
 }
@@ -793,4 +821,1119 @@ HWTEST_F(SurfaceTest, surface_006, TestSize.Level1)
     delete surface;
     delete consumerListener;
 }
+
+/*
+ * Feature: Surface
+ * Function: Surface single process buffer cycle with multi buffers
+ * SubFunction: NA
+ * FunctionPoints: buffer request, flush, acquire and release in queue order.
+ * EnvConditions: NA
+ * CaseDescription: Surface single process cycles all buffers of the queue.
+ */
+HWTEST_F(SurfaceTest, surface_007, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+
+    surface->SetQueueSize(3); // 3 : queue size
+    surface->SetSize(1024); // Set alloc 1024B SHM
+    SurfaceBuffer* requestBuffers[3] = {nullptr}; // 3 : queue size
+    for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+        requestBuffers[i] = surface->RequestBuffer();
+        ASSERT_TRUE(requestBuffers[i]);
+    }
+    EXPECT_FALSE(surface->RequestBuffer()); // all buffers are requested, return null pointer
+
+    for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+        EXPECT_EQ(0, surface->FlushBuffer(requestBuffers[i]));
+    }
+    for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+        SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+        EXPECT_EQ(requestBuffers[i], acquireBuffer); // dirty queue is fifo
+        EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+    }
+    EXPECT_FALSE(surface->AcquireBuffer());
+
+    SurfaceBuffer* requestBuffer = surface->RequestBuffer();
+    EXPECT_EQ(requestBuffers[0], requestBuffer); // free queue is fifo
+    surface->CancelBuffer(requestBuffer);
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface single process flush Buffer by slot
+ * SubFunction: NA
+ * FunctionPoints: buffer queue finds buffer by slot and generation.
+ * EnvConditions: NA
+ * CaseDescription: Surface single process rejects buffer with stale slot generation.
+ */
+HWTEST_F(SurfaceTest, surface_008, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+
+    surface->SetSize(1024); // Set alloc 1024B SHM
+    SurfaceBufferImpl* requestBuffer = reinterpret_cast<SurfaceBufferImpl*>(surface->RequestBuffer());
+    ASSERT_TRUE(requestBuffer);
+    EXPECT_NE(BUFFER_SLOT_INVALID, requestBuffer->GetSlot());
+
+    SurfaceBufferImpl staleBuffer;
+    staleBuffer.SetKey(requestBuffer->GetKey());
+    staleBuffer.SetPhyAddr(requestBuffer->GetPhyAddr());
+    staleBuffer.SetSlot(requestBuffer->GetSlot(), requestBuffer->GetGeneration() + 1);
+    EXPECT_TRUE(surface->FlushBuffer(&staleBuffer) != 0); // generation mismatch, could not flush.
+
+    staleBuffer.SetSlot(requestBuffer->GetSlot(), requestBuffer->GetGeneration());
+    EXPECT_EQ(0, surface->FlushBuffer(&staleBuffer)); // same slot and generation, could flush.
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface single process lock free mode
+ * SubFunction: NA
+ * FunctionPoints: buffer request, flush, acquire, release and cancel in lock free mode.
+ * EnvConditions: NA
+ * CaseDescription: Surface single process cycles buffers in lock free mode.
+ */
+HWTEST_F(SurfaceTest, surface_009, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+
+    surface->SetLockFreeMode(true);
+    surface->SetQueueSize(2); // 2 : queue size
+    surface->SetSize(1024); // Set alloc 1024B SHM
+    SurfaceBuffer* bufferFirst = surface->RequestBuffer();
+    ASSERT_TRUE(bufferFirst);
+    SurfaceBuffer* bufferSecond = surface->RequestBuffer();
+    ASSERT_TRUE(bufferSecond);
+    EXPECT_FALSE(surface->RequestBuffer()); // all buffers are requested, return null pointer
+
+    surface->CancelBuffer(bufferSecond);
+    EXPECT_EQ(bufferSecond, surface->RequestBuffer()); // canceled buffer is requested again
+
+    bufferFirst->SetInt32(10, 11); // set key-value <10, 11>
+    EXPECT_EQ(0, surface->FlushBuffer(bufferFirst));
+    SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+    ASSERT_TRUE(acquireBuffer);
+    int32_t value;
+    acquireBuffer->GetInt32(10, value);
+    EXPECT_EQ(11, value);
+
+    surface->SetSize(2048); // Set alloc 2048B SHM, attached buffers are deletePending
+    EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+    SurfaceBuffer* requestBuffer = surface->RequestBuffer();
+    ASSERT_TRUE(requestBuffer);
+    EXPECT_EQ(2048, requestBuffer->GetSize());
+    surface->CancelBuffer(requestBuffer);
+    surface->CancelBuffer(bufferSecond);
+
+    surface->SetLockFreeMode(false);
+    EXPECT_TRUE(surface->RequestBuffer());
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface single process request buffer with timeout
+ * SubFunction: NA
+ * FunctionPoints: buffer request waits no longer than timeout.
+ * EnvConditions: NA
+ * CaseDescription: Surface single process request buffer with timeout returns null when queue is exhausted.
+ */
+HWTEST_F(SurfaceTest, surface_010, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 454); // 454 : width and height
+
+    SurfaceBuffer* bufferFirst = surface->RequestBuffer(1, 1000000); // 1000000 : wait 1ms
+    ASSERT_TRUE(bufferFirst);
+    EXPECT_FALSE(surface->RequestBuffer(1, 1000000)); // queue size is 1, timed out
+    EXPECT_FALSE(surface->RequestBuffer(0, -1));
+    surface->CancelBuffer(bufferFirst);
+    EXPECT_EQ(bufferFirst, surface->RequestBuffer(1, 0));
+    surface->CancelBuffer(bufferFirst);
+
+    surface->SetLockFreeMode(true);
+    bufferFirst = surface->RequestBuffer(1, 1000000); // 1000000 : wait 1ms
+    ASSERT_TRUE(bufferFirst);
+    EXPECT_FALSE(surface->RequestBuffer(1, 1000000)); // queue size is 1, timed out
+    surface->CancelBuffer(bufferFirst);
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface single process mailbox mode
+ * SubFunction: NA
+ * FunctionPoints: the latest flushed buffer replaces the buffers not acquired yet.
+ * EnvConditions: NA
+ * CaseDescription: Surface single process acquires the latest buffer in mailbox mode.
+ */
+HWTEST_F(SurfaceTest, surface_011, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 454); // 454 : width and height
+    surface->SetQueueSize(3); // 3 : queue size
+    surface->SetMailboxMode(true);
+
+    for (int32_t round = 0; round < 2; round++) { // 2 : lock mode and lock free mode
+        surface->SetLockFreeMode(round == 1);
+        SurfaceBuffer* requestBuffers[3] = {nullptr}; // 3 : queue size
+        for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+            requestBuffers[i] = surface->RequestBuffer();
+            ASSERT_TRUE(requestBuffers[i]);
+            requestBuffers[i]->SetInt32(1, i); // set key-value <1, i>
+        }
+        for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+            EXPECT_EQ(0, surface->FlushBuffer(requestBuffers[i]));
+        }
+        SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+        EXPECT_EQ(requestBuffers[2], acquireBuffer); // 2 : the latest flushed buffer
+        int32_t value = -1;
+        acquireBuffer->GetInt32(1, value);
+        EXPECT_EQ(2, value); // 2 : the latest flushed value
+        EXPECT_FALSE(surface->AcquireBuffer());
+
+        SurfaceBuffer* bufferFirst = surface->RequestBuffer();
+        SurfaceBuffer* bufferSecond = surface->RequestBuffer();
+        EXPECT_TRUE(bufferFirst && bufferSecond); // dropped buffers are back to free queue
+        surface->CancelBuffer(bufferFirst);
+        surface->CancelBuffer(bufferSecond);
+        EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+    }
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface single process reuses freed buffer
+ * SubFunction: NA
+ * FunctionPoints: buffer manager keeps freed buffers in recycle pool for the same attributes.
+ * EnvConditions: NA
+ * CaseDescription: Surface single process reuses the buffer cleared after toggling width and height, or the
+ *                  custom size, when the pool has a budget.
+ */
+HWTEST_F(SurfaceTest, surface_012, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    BufferManager::GetInstance()->SetPoolBudget(0x400000); // 0x400000 : 4M bytes, pool is disabled by default
+    surface->SetWidthAndHeight(454, 454); // 454 : width and height
+
+    SurfaceBufferImpl* bufferFirst = reinterpret_cast<SurfaceBufferImpl*>(surface->RequestBuffer());
+    ASSERT_TRUE(bufferFirst);
+    int32_t key = bufferFirst->GetKey();
+    void* virAddr = bufferFirst->GetVirAddr();
+    ASSERT_TRUE(virAddr);
+    *static_cast<uint8_t*>(virAddr) = 0xFF; // 0xFF : pixels of the old owner
+    surface->CancelBuffer(bufferFirst);
+
+    surface->SetWidthAndHeight(200, 100); // 200 : width, 100 : height, free buffers go to recycle pool
+    SurfaceBuffer* bufferSecond = surface->RequestBuffer();
+    ASSERT_TRUE(bufferSecond);
+    surface->CancelBuffer(bufferSecond);
+
+    surface->SetWidthAndHeight(454, 454); // 454 : width and height
+    SurfaceBufferImpl* bufferThird = reinterpret_cast<SurfaceBufferImpl*>(surface->RequestBuffer());
+    ASSERT_TRUE(bufferThird);
+    EXPECT_EQ(key, bufferThird->GetKey());
+    EXPECT_EQ(virAddr, bufferThird->GetVirAddr());
+    EXPECT_EQ(0, *static_cast<uint8_t*>(bufferThird->GetVirAddr())); // reused buffer is cleared
+    surface->CancelBuffer(bufferThird);
+
+    /* Custom size buffer of cached usage is reused and cleared the same way. */
+    surface->SetUsage(BUFFER_CONSUMER_USAGE_HARDWARE_CONSUMER_CACHE);
+    surface->SetSize(1024); // 1024 : custom size
+    SurfaceBufferImpl* bufferSized = reinterpret_cast<SurfaceBufferImpl*>(surface->RequestBuffer());
+    ASSERT_TRUE(bufferSized);
+    key = bufferSized->GetKey();
+    virAddr = bufferSized->GetVirAddr();
+    ASSERT_TRUE(virAddr);
+    *static_cast<uint8_t*>(virAddr) = 0xFF; // 0xFF : pixels of the old owner
+    surface->CancelBuffer(bufferSized);
+
+    surface->SetSize(2048); // 2048 : another custom size, free buffers go to recycle pool
+    surface->SetSize(1024); // 1024 : custom size
+    bufferSized = reinterpret_cast<SurfaceBufferImpl*>(surface->RequestBuffer());
+    ASSERT_TRUE(bufferSized);
+    EXPECT_EQ(key, bufferSized->GetKey());
+    EXPECT_EQ(0, *static_cast<uint8_t*>(bufferSized->GetVirAddr())); // reused buffer is cleared
+    surface->CancelBuffer(bufferSized);
+
+    delete surface;
+    BufferManager::GetInstance()->SetPoolBudget(0);
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface single process preallocate buffers
+ * SubFunction: NA
+ * FunctionPoints: buffers are attached up to queue size before request.
+ * EnvConditions: NA
+ * CaseDescription: Surface single process preallocates buffers synchronously and asynchronously.
+ */
+HWTEST_F(SurfaceTest, surface_013, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    EXPECT_NE(0, surface->Preallocate()); // width and height are not set
+    surface->SetWidthAndHeight(454, 454); // 454 : width and height
+    surface->SetQueueSize(3); // 3 : queue size
+    EXPECT_EQ(0, surface->Preallocate());
+
+    SurfaceBuffer* requestBuffers[3] = {nullptr}; // 3 : queue size
+    for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+        requestBuffers[i] = surface->RequestBuffer();
+        ASSERT_TRUE(requestBuffers[i]);
+    }
+    EXPECT_FALSE(surface->RequestBuffer());
+    for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+        surface->CancelBuffer(requestBuffers[i]);
+    }
+
+    surface->SetLockFreeMode(true);
+    surface->SetWidthAndHeight(200, 100); // 200 : width, 100 : height, all buffers are freed
+    EXPECT_EQ(0, surface->Preallocate(true));
+    for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+        requestBuffers[i] = surface->RequestBuffer(1);
+        ASSERT_TRUE(requestBuffers[i]);
+    }
+    EXPECT_FALSE(surface->RequestBuffer());
+    for (int32_t i = 0; i < 3; i++) { // 3 : queue size
+        surface->CancelBuffer(requestBuffers[i]);
+    }
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface set and get attributes
+ * SubFunction: NA
+ * FunctionPoints: all buffer attributes are set and got at once.
+ * EnvConditions: NA
+ * CaseDescription: Surface sets attributes with one reset, and keeps buffers when attributes are not changed.
+ *                  Invalid attributes are rejected without changing any attribute.
+ */
+HWTEST_F(SurfaceTest, surface_014, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+
+    SurfaceAttributes attributes = {0};
+    attributes.width = 454; // 454 : width
+    attributes.height = 200; // 200 : height
+    attributes.format = IMAGE_PIXEL_FORMAT_ARGB8888;
+    attributes.strideAlignment = 8; // 8 : stride alignment
+    attributes.usage = BUFFER_CONSUMER_USAGE_SORTWARE;
+    attributes.queueSize = 2; // 2 : queue size
+    EXPECT_EQ(0, surface->SetAttributes(attributes));
+
+    SurfaceAttributes result = {0};
+    EXPECT_EQ(0, surface->GetAttributes(result));
+    EXPECT_EQ(454, result.width);
+    EXPECT_EQ(200, result.height);
+    EXPECT_EQ(IMAGE_PIXEL_FORMAT_ARGB8888, result.format);
+    EXPECT_EQ(8, result.strideAlignment);
+    EXPECT_EQ(2, result.queueSize);
+    EXPECT_EQ(0, result.size);
+
+    SurfaceBuffer* buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    void* virAddr = buffer->GetVirAddr();
+    surface->CancelBuffer(buffer);
+    EXPECT_EQ(0, surface->SetAttributes(attributes)); // not changed, buffers are kept
+    buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(virAddr, buffer->GetVirAddr());
+    surface->CancelBuffer(buffer);
+
+    attributes.size = 1024; // 1024 : custom size
+    EXPECT_EQ(0, surface->SetAttributes(attributes));
+    buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(1024, buffer->GetSize());
+    surface->CancelBuffer(buffer);
+
+    attributes.queueSize = 0;
+    EXPECT_NE(0, surface->SetAttributes(attributes));
+    delete surface;
+
+    /* Buffer queue gets attributes from ipc directly, an invalid one leaves all attributes unchanged. */
+    ASSERT_TRUE(BufferManager::GetInstance()->Init());
+    BufferQueue* queue = new BufferQueue();
+    ASSERT_TRUE(queue->Init());
+    attributes.queueSize = 2; // 2 : queue size
+    EXPECT_EQ(0, queue->SetAttributes(attributes));
+    SurfaceAttributes invalid = attributes;
+    invalid.width = 0;
+    EXPECT_NE(0, queue->SetAttributes(invalid));
+    invalid = attributes;
+    invalid.strideAlignment = 0;
+    EXPECT_NE(0, queue->SetAttributes(invalid));
+    invalid = attributes;
+    invalid.height = SURFACE_MAX_HEIGHT + 1;
+    EXPECT_NE(0, queue->SetAttributes(invalid));
+    queue->GetAttributes(result);
+    EXPECT_EQ(454, result.width);
+    EXPECT_EQ(200, result.height);
+    EXPECT_EQ(8, result.strideAlignment);
+    EXPECT_EQ(1024, result.size);
+    delete queue;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface enable control ring
+ * SubFunction: NA
+ * FunctionPoints: control ring is only for producer in another process.
+ * EnvConditions: NA
+ * CaseDescription: Consumer surface fails to enable control ring, and requests and flushes buffers as before.
+ */
+HWTEST_F(SurfaceTest, surface_015, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+
+    EXPECT_NE(0, surface->EnableControlRing());
+    SurfaceBuffer* buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0, surface->FlushBuffer(buffer));
+    SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+    ASSERT_TRUE(acquireBuffer);
+    EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface asynchronous flush mode
+ * SubFunction: NA
+ * FunctionPoints: asynchronous flush mode is only for producer in another process.
+ * EnvConditions: NA
+ * CaseDescription: Consumer surface ignores asynchronous flush mode, and flushes buffers synchronously.
+ */
+HWTEST_F(SurfaceTest, surface_016, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+    surface->SetAsyncFlushMode(true);
+
+    SurfaceBuffer* buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0, surface->FlushBuffer(buffer));
+    EXPECT_NE(0, surface->FlushBuffer(buffer)); // flushed already, sync flush reports error directly
+    EXPECT_EQ(0, surface->GetAsyncFlushError());
+    SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+    ASSERT_TRUE(acquireBuffer);
+    EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface buffer extra data
+ * SubFunction: NA
+ * FunctionPoints: extra data more than inline storage.
+ * EnvConditions: NA
+ * CaseDescription: Surface buffer keeps int32 and int64 extra data of many keys set in any order.
+ */
+HWTEST_F(SurfaceTest, surface_017, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+
+    SurfaceBuffer* buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    const uint32_t count = 24; // 24 : more than inline storage
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t key = (i * 7) % count; // 7 : set keys out of order
+        EXPECT_EQ(0, buffer->SetInt32(key, key));
+    }
+    EXPECT_EQ(0, buffer->SetInt64(count, 1LL << 40)); // 40 : value beyond int32
+    EXPECT_EQ(0, surface->FlushBuffer(buffer));
+
+    SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+    ASSERT_TRUE(acquireBuffer);
+    for (uint32_t key = 0; key < count; key++) {
+        int32_t value = -1;
+        EXPECT_EQ(0, acquireBuffer->GetInt32(key, value));
+        EXPECT_EQ(key, value);
+    }
+    int64_t value64 = 0;
+    EXPECT_EQ(0, acquireBuffer->GetInt64(count, value64));
+    EXPECT_EQ(1LL << 40, value64); // 40 : value beyond int32
+    EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface buffer blob extra data
+ * SubFunction: NA
+ * FunctionPoints: blob extra data set, overwrite and get.
+ * EnvConditions: NA
+ * CaseDescription: Surface buffer keeps blob extra data up to the max size, and refuses larger blob.
+ */
+HWTEST_F(SurfaceTest, surface_018, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+
+    SurfaceBuffer* buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    const uint32_t maxSize = 256; // 256 : max size of one blob
+    uint8_t blob[maxSize + 1];
+    for (uint32_t i = 0; i <= maxSize; i++) {
+        blob[i] = static_cast<uint8_t>(i);
+    }
+    EXPECT_NE(0, buffer->SetBlob(1, blob, maxSize + 1));
+    EXPECT_EQ(0, buffer->SetBlob(1, blob, maxSize));
+    EXPECT_EQ(0, buffer->SetBlob(2, blob, maxSize)); // 2 : blob key
+    EXPECT_EQ(0, buffer->SetBlob(1, blob + 1, 10)); // 10 : overwrite with smaller blob
+    EXPECT_EQ(0, surface->FlushBuffer(buffer));
+
+    SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+    ASSERT_TRUE(acquireBuffer);
+    uint8_t data[maxSize] = {0};
+    uint32_t size = 0;
+    EXPECT_EQ(0, acquireBuffer->GetBlob(1, nullptr, size));
+    EXPECT_EQ(10, size); // 10 : size of blob
+    size = 5; // 5 : smaller than the blob
+    EXPECT_NE(0, acquireBuffer->GetBlob(1, data, size));
+    EXPECT_EQ(10, size); // 10 : size of blob
+    size = sizeof(data);
+    EXPECT_EQ(0, acquireBuffer->GetBlob(1, data, size));
+    EXPECT_EQ(0, memcmp(data, blob + 1, size));
+    size = sizeof(data);
+    EXPECT_EQ(0, acquireBuffer->GetBlob(2, data, size)); // 2 : blob key
+    EXPECT_EQ(maxSize, size);
+    EXPECT_EQ(0, memcmp(data, blob, size));
+    int32_t value = 0;
+    EXPECT_NE(0, acquireBuffer->GetInt32(1, value));
+    EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface latency stats
+ * SubFunction: NA
+ * FunctionPoints: buffer cycle latency histograms.
+ * EnvConditions: NA
+ * CaseDescription: Surface records one latency of each buffer cycle stage, canceled buffer is not counted.
+ */
+HWTEST_F(SurfaceTest, surface_019, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+
+    const uint32_t count = 3; // 3 : buffer cycles
+    for (uint32_t i = 0; i < count; i++) {
+        SurfaceBuffer* buffer = surface->RequestBuffer();
+        ASSERT_TRUE(buffer);
+        EXPECT_EQ(0, surface->FlushBuffer(buffer));
+        SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+        ASSERT_TRUE(acquireBuffer);
+        EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+    }
+    SurfaceBuffer* buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    surface->CancelBuffer(buffer);
+
+    SurfaceLatencyStats stats;
+    EXPECT_EQ(0, surface->GetLatencyStats(stats));
+    EXPECT_EQ(count, stats.producerHold.count);
+    EXPECT_EQ(count, stats.queueDwell.count);
+    EXPECT_EQ(count, stats.consumerHold.count);
+    EXPECT_EQ(count + 1, stats.requestWait.count);
+    uint32_t bucketCount = 0;
+    for (uint8_t i = 0; i < SURFACE_LATENCY_BUCKET_COUNT; i++) {
+        bucketCount += stats.consumerHold.buckets[i];
+    }
+    EXPECT_EQ(count, bucketCount);
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface stats
+ * SubFunction: NA
+ * FunctionPoints: request, flush and acquire counters.
+ * EnvConditions: NA
+ * CaseDescription: Surface counts failed requests and empty acquires, and the peak depth of dirty buffers.
+ */
+HWTEST_F(SurfaceTest, surface_020, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+    surface->SetQueueSize(2); // 2 : queue size
+
+    EXPECT_EQ(nullptr, surface->AcquireBuffer());
+    SurfaceBuffer* buffer = surface->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    SurfaceBuffer* buffer1 = surface->RequestBuffer();
+    ASSERT_TRUE(buffer1);
+    EXPECT_EQ(nullptr, surface->RequestBuffer());
+    EXPECT_EQ(0, surface->FlushBuffer(buffer));
+    EXPECT_EQ(0, surface->FlushBuffer(buffer1));
+
+    SurfaceStats stats;
+    EXPECT_EQ(0, surface->GetStats(stats));
+    EXPECT_EQ(3, stats.requests); // 3 : request count
+    EXPECT_EQ(2, stats.requestSucceeded); // 2 : buffer count
+    EXPECT_EQ(1, stats.requestFailed);
+    EXPECT_EQ(2, stats.flushes); // 2 : buffer count
+    EXPECT_EQ(1, stats.acquires);
+    EXPECT_EQ(1, stats.emptyAcquires);
+    EXPECT_EQ(2, stats.allocs); // 2 : buffer count
+    EXPECT_EQ(2, stats.peakDirtyDepth); // 2 : buffer count
+
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Software gralloc
+ * SubFunction: NA
+ * FunctionPoints: alloc, map by key and free of software allocator backend.
+ * EnvConditions: NA
+ * CaseDescription: Buffer of software allocator backend could be mapped by key, and shares content. Mapping a
+ *                  handle again replaces its mapping, and freeing removes the segment.
+ */
+HWTEST_F(SurfaceTest, surface_021, TestSize.Level1)
+{
+    GrallocFuncs* funcs = nullptr;
+    ASSERT_EQ(DISPLAY_SUCCESS, SoftGrallocInitialize(&funcs));
+    AllocInfo info = {};
+    info.width = 33; // 33 : width
+    info.height = 10; // 10 : height
+    info.format = PIXEL_FMT_RGB_565;
+    BufferHandle* handle = nullptr;
+    ASSERT_EQ(DISPLAY_SUCCESS, funcs->AllocMem(&info, &handle));
+    EXPECT_EQ(68, handle->stride); // 68 : 33 pixels of 2 bytes aligned to 4
+    EXPECT_EQ(680, handle->size); // 680 : stride * height
+    (void)memset_s(handle->virAddr, handle->size, 0x5a, handle->size); // 0x5a : pattern
+
+    BufferHandle mapped = *handle;
+    mapped.virAddr = nullptr;
+    uint8_t* addr = static_cast<uint8_t*>(funcs->Mmap(&mapped));
+    ASSERT_TRUE(addr);
+    EXPECT_EQ(2, GetAttachCount(handle->key)); // 2 : attached by alloc and map
+    addr = static_cast<uint8_t*>(funcs->Mmap(&mapped));
+    ASSERT_TRUE(addr);
+    EXPECT_EQ(2, GetAttachCount(handle->key)); // 2 : the first map is detached
+    EXPECT_EQ(0x5a, addr[handle->size - 1]); // 0x5a : pattern
+    EXPECT_EQ(DISPLAY_SUCCESS, funcs->FlushCache(&mapped));
+    EXPECT_EQ(DISPLAY_SUCCESS, funcs->Unmap(&mapped));
+    int32_t key = handle->key;
+    funcs->FreeMem(handle);
+    EXPECT_EQ(0, GetAttachCount(key));
+
+    info.width = SURFACE_MAX_WIDTH;
+    info.height = SURFACE_MAX_HEIGHT;
+    info.format = PIXEL_FMT_RGBA_8888;
+    EXPECT_NE(DISPLAY_SUCCESS, funcs->AllocMem(&info, &handle));
+    EXPECT_EQ(DISPLAY_SUCCESS, SoftGrallocUninitialize(funcs));
+}
+
+/*
+ * Feature: Surface
+ * Function: Buffer queue invariants
+ * SubFunction: NA
+ * FunctionPoints: Buffer queue bookkeeping keeps consistent when queue is reconfigured with buffers in flight.
+ * EnvConditions: NA
+ * CaseDescription: Check invariants of buffer queue after request, flush, cancel, acquire, resize and reset.
+ */
+HWTEST_F(SurfaceTest, surface_022, TestSize.Level1)
+{
+    ASSERT_TRUE(BufferManager::GetInstance()->Init());
+    BufferQueue* queue = new BufferQueue();
+    ASSERT_TRUE(queue->Init());
+    queue->SetWidthAndHeight(101, 202); // 101 : width, 202 : height
+    queue->SetQueueSize(3); // 3 : queue size
+    SurfaceBufferImpl* buffer = queue->RequestBuffer(0);
+    ASSERT_TRUE(buffer);
+    SurfaceBufferImpl* buffer1 = queue->RequestBuffer(0);
+    ASSERT_TRUE(buffer1);
+    SurfaceBufferImpl* buffer2 = queue->RequestBuffer(0);
+    ASSERT_TRUE(buffer2);
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->FlushBuffer(*buffer));
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->FlushBuffer(*buffer1));
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CancelBuffer(*buffer2));
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+
+    SurfaceBufferImpl* acquired = queue->AcquireBuffer();
+    ASSERT_TRUE(acquired);
+    queue->SetQueueSize(1);
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+    EXPECT_TRUE(queue->ReleaseBuffer(*acquired));
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+
+    queue->SetWidthAndHeight(202, 101); // 202 : width, 101 : height
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+    acquired = queue->AcquireBuffer();
+    ASSERT_TRUE(acquired);
+    EXPECT_TRUE(queue->ReleaseBuffer(*acquired));
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+
+    buffer = queue->RequestBuffer(0);
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(nullptr, queue->RequestBuffer(0));
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CancelBuffer(*buffer));
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+    delete queue;
+}
+
+/*
+ * Feature: Surface
+ * Function: Surface buffer damage
+ * SubFunction: NA
+ * FunctionPoints: Damage rectangles are carried from producer to consumer, and merged for dropped frames.
+ * EnvConditions: NA
+ * CaseDescription: Consumer gets damage set by producer, through ipc data and in mailbox mode.
+ */
+HWTEST_F(SurfaceTest, surface_023, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    surface->SetWidthAndHeight(454, 454); // 454 : width and height
+    surface->SetQueueSize(2); // 2 : queue size
+    surface->SetMailboxMode(true);
+    const SurfaceDamageRect damage[2] = {{0, 0, 10, 20}, {100, 200, 30, 40}}; // 2 : count of damage rectangles
+    const SurfaceDamageRect invalid = {450, 0, SURFACE_MAX_WIDTH, 1};
+    SurfaceDamageRect rects[SURFACE_MAX_DAMAGE_COUNT];
+    uint32_t count = SURFACE_MAX_DAMAGE_COUNT;
+
+    for (int32_t round = 0; round < 2; round++) { // 2 : lock mode and lock free mode
+        surface->SetLockFreeMode(round == 1);
+        SurfaceBuffer* first = surface->RequestBuffer();
+        ASSERT_TRUE(first);
+        count = SURFACE_MAX_DAMAGE_COUNT;
+        EXPECT_EQ(0, first->GetDamage(rects, count));
+        EXPECT_EQ(0, count); // requested buffer is damaged as a whole
+        EXPECT_NE(0, first->SetDamage(&invalid, 1));
+        EXPECT_EQ(0, first->SetDamage(&damage[0], 1));
+        SurfaceBuffer* second = surface->RequestBuffer();
+        ASSERT_TRUE(second);
+        EXPECT_EQ(0, second->SetDamage(&damage[1], 1));
+        EXPECT_EQ(0, surface->FlushBuffer(first));
+        EXPECT_EQ(0, surface->FlushBuffer(second));
+
+        SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+        ASSERT_EQ(second, acquireBuffer);
+        count = 1;
+        EXPECT_NE(0, acquireBuffer->GetDamage(rects, count));
+        EXPECT_EQ(2, count); // 2 : damage of dropped frame is merged
+        EXPECT_EQ(0, acquireBuffer->GetDamage(rects, count));
+        EXPECT_EQ(0, memcmp(&damage[1], &rects[0], sizeof(SurfaceDamageRect)));
+        EXPECT_EQ(0, memcmp(&damage[0], &rects[1], sizeof(SurfaceDamageRect)));
+        EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+    }
+    delete surface;
+
+    SurfaceBufferImpl buffer;
+    SurfaceDamageRect many[SURFACE_MAX_DAMAGE_COUNT + 1];
+    for (uint32_t i = 0; i <= SURFACE_MAX_DAMAGE_COUNT; i++) {
+        many[i] = {i * 10, i * 10, 5, 5}; // 10 : distance of rectangles, 5 : width and height
+    }
+    EXPECT_EQ(0, buffer.SetDamage(many, SURFACE_MAX_DAMAGE_COUNT + 1));
+    uint8_t data[512]; // 512 : ipc data size
+    IpcIo io;
+    IpcIoInit(&io, data, sizeof(data), 0);
+    buffer.WriteToIpcIo(io);
+    IpcIo reader;
+    IpcIoInit(&reader, data, sizeof(data), 0);
+    SurfaceBufferImpl readBuffer;
+    readBuffer.ReadFromIpcIo(reader);
+    count = SURFACE_MAX_DAMAGE_COUNT;
+    EXPECT_EQ(0, readBuffer.GetDamage(rects, count));
+    EXPECT_EQ(SURFACE_MAX_DAMAGE_COUNT, count);
+    EXPECT_EQ(150, rects[SURFACE_MAX_DAMAGE_COUNT - 1].x); // 150 : left of the 16th rectangle
+    EXPECT_EQ(15, rects[SURFACE_MAX_DAMAGE_COUNT - 1].width); // 15 : the last rectangle grows to cover the 17th
+}
+/*
+ * Feature: Surface
+ * Function: Surface asynchronous flush mode through ipc
+ * SubFunction: NA
+ * FunctionPoints: one-way flush of ipc producer, deferred flush error.
+ * EnvConditions: NA
+ * CaseDescription: Ipc producer flushes buffers one-way, and a failed flush is reported once by the next request.
+ */
+HWTEST_F(SurfaceTest, surface_024, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    Surface* producer = CreateIpcProducer(surface);
+    ASSERT_TRUE(producer);
+    producer->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+    producer->SetAsyncFlushMode(true);
+
+    const int32_t cycles = 5; // 5 : more cycles than queue size
+    for (int32_t i = 0; i < cycles; i++) {
+        SurfaceBuffer* buffer = producer->RequestBuffer();
+        ASSERT_TRUE(buffer);
+        EXPECT_EQ(0, buffer->SetInt32(1, i));
+        EXPECT_EQ(0, producer->FlushBuffer(buffer));
+        SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+        ASSERT_TRUE(acquireBuffer);
+        int32_t value = -1;
+        EXPECT_EQ(0, acquireBuffer->GetInt32(1, value));
+        EXPECT_EQ(i, value);
+        EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+    }
+    EXPECT_EQ(0, producer->GetAsyncFlushError());
+
+    SurfaceBuffer* buffer = producer->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0, producer->FlushBuffer(buffer));
+    EXPECT_EQ(0, producer->FlushBuffer(buffer)); // flushed already, fails on consumer side later
+    EXPECT_EQ(0, producer->GetAsyncFlushError());
+    SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+    ASSERT_TRUE(acquireBuffer);
+    EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+
+    buffer = producer->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_NE(0, producer->GetAsyncFlushError());
+    EXPECT_EQ(0, producer->GetAsyncFlushError()); // reported once
+    producer->CancelBuffer(buffer);
+
+    delete producer;
+    delete surface;
+}
+#ifdef SURFACE_SOFT_GRALLOC
+/*
+ * Feature: Surface
+ * Function: Ipc producer buffer cache
+ * SubFunction: NA
+ * FunctionPoints: ipc producer drops cached mappings when consumer resets buffer queue.
+ * EnvConditions: software gralloc, liteipc or loopback transport.
+ * CaseDescription: After consumer changes attributes, next request of ipc producer unmaps all detached buffers,
+ *                  including the ones whose slots are not requested again.
+ */
+HWTEST_F(SurfaceTest, surface_025, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    Surface* producer = CreateIpcProducer(surface);
+    ASSERT_TRUE(producer);
+    const uint8_t queueSize = 3; // 3 : more than one slot
+    producer->SetQueueSize(queueSize);
+    producer->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+
+    int32_t keys[queueSize];
+    SurfaceBuffer* buffers[queueSize];
+    for (uint8_t i = 0; i < queueSize; i++) {
+        buffers[i] = producer->RequestBuffer();
+        ASSERT_TRUE(buffers[i]);
+        keys[i] = static_cast<int32_t>(static_cast<SurfaceBufferImpl*>(buffers[i])->GetKey());
+    }
+    for (uint8_t i = 0; i < queueSize; i++) {
+        EXPECT_EQ(0, producer->FlushBuffer(buffers[i]));
+        SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+        ASSERT_TRUE(acquireBuffer);
+        EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+    }
+
+    surface->SetWidthAndHeight(200, 100); // 200 : width, 100 : height
+    int32_t attachCounts[queueSize];
+    for (uint8_t i = 0; i < queueSize; i++) {
+        attachCounts[i] = GetAttachCount(keys[i]);
+        EXPECT_LT(0, attachCounts[i]); // still mapped by producer
+    }
+    SurfaceBuffer* buffer = producer->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    for (uint8_t i = 0; i < queueSize; i++) {
+        EXPECT_EQ(attachCounts[i] - 1, GetAttachCount(keys[i]));
+    }
+    EXPECT_EQ(200, producer->GetWidth()); // 200 : width
+    producer->CancelBuffer(buffer);
+
+    delete producer;
+    delete surface;
+}
+#endif
+
+/*
+ * Feature: Surface
+ * Function: Ipc producer attributes cache
+ * SubFunction: NA
+ * FunctionPoints: ipc producer serves attribute getters from the snapshot refreshed by request buffer.
+ * EnvConditions: NA
+ * CaseDescription: Attributes changed by consumer are not seen by ipc producer getters until the next request
+ *                  buffer, which brings the new snapshot; attributes changed by producer are seen at once.
+ */
+HWTEST_F(SurfaceTest, surface_026, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    Surface* producer = CreateIpcProducer(surface);
+    ASSERT_TRUE(producer);
+    producer->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+    EXPECT_EQ(454, producer->GetWidth()); // 454 : width
+    EXPECT_EQ(200, producer->GetHeight()); // 200 : height
+
+    SurfaceBuffer* buffer = producer->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(surface->GetSize(), producer->GetSize());
+    EXPECT_EQ(surface->GetStride(), producer->GetStride());
+    producer->CancelBuffer(buffer);
+
+    surface->SetWidthAndHeight(200, 100); // 200 : width, 100 : height
+    surface->SetFormat(IMAGE_PIXEL_FORMAT_ARGB8888);
+    EXPECT_EQ(454, producer->GetWidth()); // 454 : served from the snapshot
+    EXPECT_EQ(IMAGE_PIXEL_FORMAT_RGB565, producer->GetFormat());
+
+    buffer = producer->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(200, producer->GetWidth()); // 200 : width
+    EXPECT_EQ(100, producer->GetHeight()); // 100 : height
+    EXPECT_EQ(IMAGE_PIXEL_FORMAT_ARGB8888, producer->GetFormat());
+    EXPECT_EQ(surface->GetSize(), producer->GetSize());
+    EXPECT_EQ(surface->GetStride(), producer->GetStride());
+    producer->CancelBuffer(buffer);
+
+    producer->SetQueueSize(2); // 2 : queue size
+    EXPECT_EQ(2, producer->GetQueueSize()); // 2 : queue size
+
+    delete producer;
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Buffer queue control ring
+ * SubFunction: NA
+ * FunctionPoints: producer side of the control ring, flush and give back of buffers, request without waiting.
+ * EnvConditions: NA
+ * CaseDescription: Take free buffers from the control ring as a producer, push one flushed, one canceled and one
+ *                  stale entry back, and check how buffer queue drains them.
+ */
+HWTEST_F(SurfaceTest, surface_027, TestSize.Level1)
+{
+    ASSERT_TRUE(BufferManager::GetInstance()->Init());
+    BufferQueue* queue = new BufferQueue();
+    ASSERT_TRUE(queue->Init());
+    queue->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+    queue->SetQueueSize(2); // 2 : queue size
+    SurfaceBufferImpl* controlBuffer = queue->EnableControlRing();
+    ASSERT_TRUE(controlBuffer);
+    BufferControlRing* ring = static_cast<BufferControlRing*>(controlBuffer->GetVirAddr());
+    ASSERT_TRUE(ring);
+    EXPECT_EQ(2, BufferQueue::GetControlQueueSize(ring->freeQueue)); // 2 : queue size
+
+    /* Free buffers wait in the control ring, request through buffer queue fails without waiting. */
+    EXPECT_FALSE(queue->RequestBuffer(1, 1000000)); // 1000000 : 1ms timeout
+    SurfaceStats stats {};
+    queue->GetStats(stats);
+    EXPECT_EQ(0, stats.waits);
+
+    BufferControlEntry flushEntry;
+    BufferControlEntry cancelEntry;
+    ASSERT_TRUE(BufferQueue::PopControlEntry(ring->freeQueue, flushEntry));
+    ASSERT_TRUE(BufferQueue::PopControlEntry(ring->freeQueue, cancelEntry));
+    EXPECT_FALSE(BufferQueue::PopControlEntry(ring->freeQueue, cancelEntry));
+    BufferControlEntry staleEntry = flushEntry;
+    staleEntry.generation++;
+    cancelEntry.canceled = 1;
+    EXPECT_TRUE(BufferQueue::PushControlEntry(ring->dirtyQueue, flushEntry));
+    EXPECT_TRUE(BufferQueue::PushControlEntry(ring->dirtyQueue, cancelEntry));
+    EXPECT_TRUE(BufferQueue::PushControlEntry(ring->dirtyQueue, staleEntry));
+    EXPECT_EQ(1, queue->DrainControlRing());
+    EXPECT_EQ(0, BufferQueue::GetControlQueueSize(ring->dirtyQueue));
+
+    SurfaceBufferImpl* acquireBuffer = queue->AcquireBuffer();
+    ASSERT_TRUE(acquireBuffer);
+    EXPECT_EQ(flushEntry.slot, acquireBuffer->GetSlot());
+    EXPECT_FALSE(queue->AcquireBuffer());
+
+    /* Canceled buffer is kept for request through buffer queue, so that the producer could map it. */
+    EXPECT_EQ(0, BufferQueue::GetControlQueueSize(ring->freeQueue));
+    SurfaceBufferImpl* buffer = queue->RequestBuffer(0);
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(cancelEntry.slot, buffer->GetSlot());
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CancelBuffer(*buffer));
+    EXPECT_TRUE(queue->ReleaseBuffer(*acquireBuffer));
+    EXPECT_EQ(0, queue->DrainControlRing());
+    EXPECT_EQ(2, BufferQueue::GetControlQueueSize(ring->freeQueue)); // 2 : queue size
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+
+    /* Queue corrupted by producer is neither drained nor used. */
+    uint32_t head = ring->dirtyQueue.head.load();
+    ring->dirtyQueue.tail.store(head + 0xFFFFFFF0); // 0xFFFFFFF0 : far more entries than slots
+    EXPECT_EQ(0, queue->DrainControlRing());
+    EXPECT_FALSE(BufferQueue::PushControlEntry(ring->dirtyQueue, flushEntry));
+    EXPECT_FALSE(BufferQueue::PopControlEntry(ring->dirtyQueue, flushEntry));
+    EXPECT_EQ(head, ring->dirtyQueue.head.load());
+    ring->dirtyQueue.tail.store(head);
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+    delete queue;
+}
+
+/*
+ * Feature: Surface
+ * Function: Ipc producer control ring
+ * SubFunction: NA
+ * FunctionPoints: ipc producer requests and flushes buffers through the control ring.
+ * EnvConditions: NA
+ * CaseDescription: Ipc producer with control ring keeps content and extra data of buffers, and gets buffers of
+ *                  new attributes after consumer resets the queue.
+ */
+HWTEST_F(SurfaceTest, surface_028, TestSize.Level1)
+{
+    Surface* surface = Surface::CreateSurface();
+    ASSERT_TRUE(surface);
+    Surface* producer = CreateIpcProducer(surface);
+    ASSERT_TRUE(producer);
+    const uint8_t queueSize = 3; // 3 : queue size
+    producer->SetQueueSize(queueSize);
+    producer->SetWidthAndHeight(454, 200); // 454 : width, 200 : height
+    EXPECT_EQ(0, producer->EnableControlRing());
+    EXPECT_EQ(0, producer->EnableControlRing()); // enabled already
+
+    const int32_t rounds = 5; // 5 : the first rounds map buffers, the others go through the ring
+    for (int32_t round = 0; round < rounds; round++) {
+        SurfaceBuffer* buffers[queueSize];
+        for (uint8_t i = 0; i < queueSize; i++) {
+            buffers[i] = producer->RequestBuffer();
+            ASSERT_TRUE(buffers[i]);
+        }
+        EXPECT_FALSE(producer->RequestBuffer());
+        for (uint8_t i = 0; i < queueSize; i++) {
+            *static_cast<int32_t*>(buffers[i]->GetVirAddr()) = round * queueSize + i;
+            EXPECT_EQ(0, producer->FlushBuffer(buffers[i]));
+        }
+        for (uint8_t i = 0; i < queueSize; i++) {
+            SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+            ASSERT_TRUE(acquireBuffer);
+            EXPECT_EQ(round * queueSize + i, *static_cast<int32_t*>(acquireBuffer->GetVirAddr()));
+            EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+        }
+    }
+
+    SurfaceBuffer* buffer = producer->RequestBuffer();
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0, buffer->SetInt32(1, 1)); // extra data goes through ipc
+    EXPECT_EQ(0, producer->FlushBuffer(buffer));
+    SurfaceBuffer* acquireBuffer = surface->AcquireBuffer();
+    ASSERT_TRUE(acquireBuffer);
+    int32_t value = 0;
+    EXPECT_EQ(0, acquireBuffer->GetInt32(1, value));
+    EXPECT_EQ(1, value);
+    EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+
+    /* Buffers in the ring attached before reset are given back, and new buffers are requested. */
+    surface->SetWidthAndHeight(200, 100); // 200 : width, 100 : height
+    for (uint8_t i = 0; i < queueSize * 2; i++) {
+        buffer = producer->RequestBuffer();
+        ASSERT_TRUE(buffer);
+        EXPECT_EQ(surface->GetSize(), buffer->GetSize());
+        EXPECT_EQ(0, producer->FlushBuffer(buffer));
+        acquireBuffer = surface->AcquireBuffer();
+        ASSERT_TRUE(acquireBuffer);
+        EXPECT_EQ(surface->GetSize(), acquireBuffer->GetSize());
+        EXPECT_TRUE(surface->ReleaseBuffer(acquireBuffer));
+    }
+
+    delete producer;
+    delete surface;
+}
+
+/*
+ * Feature: Surface
+ * Function: Buffer queue request with all slots taken
+ * SubFunction: NA
+ * FunctionPoints: request waits when deletePending buffers hold all slots.
+ * EnvConditions: NA
+ * CaseDescription: Hold buffers across two resets until every slot is taken, then request with waiting blocks
+ *                  until a held buffer is given back and detached.
+ */
+HWTEST_F(SurfaceTest, surface_029, TestSize.Level1)
+{
+    ASSERT_TRUE(BufferManager::GetInstance()->Init());
+    BufferQueue* queue = new BufferQueue();
+    ASSERT_TRUE(queue->Init());
+    queue->SetQueueSize(SURFACE_MAX_QUEUE_SIZE);
+    queue->SetWidthAndHeight(101, 202); // 101 : width, 202 : height
+    SurfaceBufferImpl* buffers[BUFFER_QUEUE_SLOT_COUNT];
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        if (i == SURFACE_MAX_QUEUE_SIZE) {
+            queue->SetWidthAndHeight(202, 101); // 202 : width, 101 : height
+        }
+        buffers[i] = queue->RequestBuffer(0);
+        ASSERT_TRUE(buffers[i]);
+    }
+    queue->SetWidthAndHeight(101, 202); // 101 : width, 202 : height, all slots hold deletePending buffers
+
+    EXPECT_FALSE(queue->RequestBuffer(1, 1000000)); // 1000000 : 1ms timeout
+    SurfaceStats stats {};
+    queue->GetStats(stats);
+    EXPECT_EQ(1, stats.waits);
+
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CancelBuffer(*buffers[0]));
+    SurfaceBufferImpl* buffer = queue->RequestBuffer(1, 1000000); // 1000000 : 1ms timeout
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0, buffer->GetDeletePending());
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CancelBuffer(*buffer));
+    for (uint8_t i = 1; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        EXPECT_EQ(SURFACE_ERROR_OK, queue->CancelBuffer(*buffers[i]));
+    }
+    EXPECT_EQ(SURFACE_ERROR_OK, queue->CheckInvariants());
+    delete queue;
+}
+
+/*
+ * Feature: Surface
+ * Function: Buffer queue ring index
+ * SubFunction: NA
+ * FunctionPoints: ring entries keep their order when the free running counters wrap.
+ * EnvConditions: NA
+ * CaseDescription: Fill and drain a control queue whose counters wrap, and check every entry comes out once.
+ */
+HWTEST_F(SurfaceTest, surface_030, TestSize.Level1)
+{
+    BufferControlQueue* queue = new BufferControlQueue();
+    ASSERT_TRUE(queue);
+    const uint32_t start = UINT32_MAX - 4; // 4 : wrap in the middle of the entries
+    queue->head = start;
+    queue->tail = start;
+    BufferControlEntry entry = {0, 0, 0, 0};
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        entry.slot = i;
+        entry.generation = i;
+        EXPECT_TRUE(BufferQueue::PushControlEntry(*queue, entry));
+    }
+    EXPECT_FALSE(BufferQueue::PushControlEntry(*queue, entry)); // full
+    EXPECT_EQ(BUFFER_QUEUE_SLOT_COUNT, BufferQueue::GetControlQueueSize(*queue));
+    for (uint8_t i = 0; i < BUFFER_QUEUE_SLOT_COUNT; i++) {
+        ASSERT_TRUE(BufferQueue::PopControlEntry(*queue, entry));
+        EXPECT_EQ(i, entry.slot);
+        EXPECT_EQ(i, entry.generation);
+    }
+    EXPECT_FALSE(BufferQueue::PopControlEntry(*queue, entry));
+    EXPECT_EQ(start + BUFFER_QUEUE_SLOT_COUNT, queue->head.load());
+    delete queue;
+}
 } // namespace OHOS